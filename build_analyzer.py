@@ -18,6 +18,7 @@ if not os.path.exists( "release" ):
 os.chdir( "release" )
 o_files = glob.glob( "*.o" )
 o_files.extend( glob.glob( "*" + dylib_ext ) )
+o_files.extend( glob.glob( "*.a" ) )
 for o_file in o_files:
     os.remove( o_file )
 os.chdir( ".." )
@@ -30,6 +31,7 @@ if not os.path.exists( "debug" ):
 os.chdir( "debug" )
 o_files = glob.glob( "*.o" );
 o_files.extend( glob.glob( "*" + dylib_ext ) )
+o_files.extend( glob.glob( "*.a" ) )
 for o_file in o_files:
     os.remove( o_file )
 os.chdir( ".." )
@@ -39,13 +41,22 @@ os.chdir( "source" )
 cpp_files = glob.glob( "*.cpp" );
 os.chdir( ".." )
 
+#the decoder core uses no Saleae headers; it goes into a static library (libAcuriteDecoder.a)
+#that the analyzer links against, and that other programs can use through AcuriteDecoderCore.h
+core_cpp_files = [ "AcuritePacket.cpp", "AcuriteEdgeDecoder.cpp", "AcuriteChannelDecoder.cpp",
+                   "AcuriteParallelDecoder.cpp", "AcuriteThreadPool.cpp", "AcuriteTrace.cpp",
+                   "AcuriteCalibration.cpp", "AcuriteGlitchFilter.cpp", "AcuriteMetrics.cpp",
+                   "AcuriteDecoderCore.cpp" ]
+core_library = "libAcuriteDecoder.a"
+
 #specify the search paths/dependencies/options for gcc
 include_paths = [ "../include" ]
 link_paths = [ "../lib" ]
-link_dependencies = [ "-lAnalyzer" ] #refers to libAnalyzer.dylib or libAnalyzer.so
+link_dependencies = [ "-lAnalyzer", "-lpthread" ] #refers to libAnalyzer.dylib or libAnalyzer.so
 
-debug_compile_flags = "-O0 -w -c -fpic -g"
-release_compile_flags = "-O3 -w -c -fpic"
+#debug builds compile in per-edge tracing (see source/AcuriteTrace.h); release builds compile it out
+debug_compile_flags = "-std=c++11 -O0 -w -c -fpic -g -DACURITE_TRACE_LEVEL=2"
+release_compile_flags = "-std=c++11 -O3 -w -c -fpic"
 
 #loop through all the cpp files, build up the gcc command line, and attempt to compile each cpp file
 for cpp_file in cpp_files:
@@ -53,9 +64,10 @@ for cpp_file in cpp_files:
     #g++
     command = "g++ -arch i386 "
 
-    #include paths
-    for path in include_paths: 
-        command += "-I\"" + path + "\" "
+    #include paths (the core is built without them, so it can't come to depend on the SDK)
+    if cpp_file not in core_cpp_files:
+        for path in include_paths: 
+            command += "-I\"" + path + "\" "
 
     release_command = command
     release_command  += release_compile_flags
@@ -73,6 +85,14 @@ for cpp_file in cpp_files:
     print debug_command
     os.system( debug_command )
     
+#archive the decoder core
+for folder in [ "release", "debug" ]:
+    command = "ar rcs \"" + folder + "/" + core_library + "\" "
+    for cpp_file in core_cpp_files:
+        command += folder + "/" + cpp_file.replace( ".cpp", ".o" ) + " "
+    print command
+    os.system( command )
+
 #lastly, link
 #g++
 command = "g++ -arch i386 "
@@ -107,10 +127,13 @@ else:
     release_command = command + "-o\"release/lib" + analyzer_name + "Analyzer.so\" "
     debug_command = command + "-o\"debug/lib" + analyzer_name + "Analyzer.so\" "
 
-#add all the object files to link
+#add all the object files to link, then the decoder core
 for cpp_file in cpp_files:
-    release_command += "release/" + cpp_file.replace( ".cpp", ".o" ) + " "
-    debug_command += "debug/" + cpp_file.replace( ".cpp", ".o" ) + " "
+    if cpp_file not in core_cpp_files:
+        release_command += "release/" + cpp_file.replace( ".cpp", ".o" ) + " "
+        debug_command += "debug/" + cpp_file.replace( ".cpp", ".o" ) + " "
+release_command += "release/" + core_library + " "
+debug_command += "debug/" + core_library + " "
     
 #run the commands from the command line
 print release_command
@@ -119,3 +142,23 @@ print debug_command
 os.system( debug_command )
 
         
+#command-line tools in /tools: one cpp file each, linked against the decoder core
+os.chdir( "tools" )
+tool_files = glob.glob( "*.cpp" )
+os.chdir( ".." )
+
+for tool_file in tool_files:
+    command = "g++ -arch i386 -I\"source\" "
+
+    release_command = command + release_compile_flags.replace( " -c -fpic", "" )
+    release_command += " -o\"release/" + tool_file.replace( ".cpp", "" ) + "\" "
+    release_command += "\"tools/" + tool_file + "\" release/" + core_library + " -lpthread"
+
+    debug_command = command + debug_compile_flags.replace( " -c -fpic", "" )
+    debug_command += " -o\"debug/" + tool_file.replace( ".cpp", "" ) + "\" "
+    debug_command += "\"tools/" + tool_file + "\" debug/" + core_library + " -lpthread"
+
+    print release_command
+    os.system( release_command )
+    print debug_command
+    os.system( debug_command )
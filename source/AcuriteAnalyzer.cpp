@@ -1,7 +1,22 @@
 #include "AcuriteAnalyzer.h"
 #include "AcuriteAnalyzerSettings.h"
 #include <AnalyzerChannelData.h>
-#include "decoders.h"
+#include "AcuriteChannelDecoder.h"
+#include "AcuriteCommitScheduler.h"
+#include "AcuritePreambleSeeker.h"
+#include "AcuriteTrace.h"
+#include <string.h>
+
+// Copies of one transmission picked up by different receivers start within
+// this much of each other...
+#define ACURITE_CORRELATION_US 5000
+// ...and are at most this many stored packets apart
+#define ACURITE_CORRELATION_LOOKBACK 64
+
+// Edges read from all inputs, or windows of ACURITE_SEGMENT_GAP_US, before
+// they're passed to the per-input decoder threads
+#define ACURITE_INPUT_BATCH_EDGES 16384
+#define ACURITE_INPUT_BATCH_WINDOWS 16
 
 AcuriteAnalyzer::AcuriteAnalyzer()
 :	Analyzer(),  
@@ -10,152 +25,391 @@ AcuriteAnalyzer::AcuriteAnalyzer()
 	mSimulationInitilized( false )
 {
 	SetAnalyzerSettings( mSettings.get() );
+	AcuriteTraceStart();
 }
 
 AcuriteAnalyzer::~AcuriteAnalyzer()
 {
 	KillThread();
+	AcuriteTraceStop();
 }
 
-void log(const char *fmt, ...)
+// Markers added to the results so far, counted across all inputs against
+// ACURITE_MARKER_BUDGET
+struct AcuriteMarkerCount
 {
-  va_list args;
-  va_start (args, fmt);
-  char buf[128];
-  vsprintf(buf, fmt, args);
-  va_end(args);
+	AcuriteMarkerCount() : mAll( 0 ), mCandidates( 0 ) {}
 
-  FILE *f = fopen("/tmp/debug.log", "a");
-  fprintf(f, "%s\n", buf);
-  fclose(f);
-}
-
-byte calcParity(byte b)
-{
-  byte result = 0;
-  for (char i=0; i<=6; i++) {
-    result ^= (b & (1<<i)) ? 1 : 0;
-  }
-  return result ? 0x80 : 0x00;
-}
+	U64 mAll;
+	U64 mCandidates; // for frame starts other than packets' own
+};
 
-void interpretData(const byte *data, int size, char *output)
+// Puts decoder output into the analyzer's results
+class AcuriteResultsSink : public AcuriteDecodeSink
 {
-  if (size != 7) {
-    sprintf(output, "Invalid data (not 7 bytes)");
-    return;
-  }
-
-  // Check parity bits. (Byte 0 and byte 7 have no parity bits.)              
-  for (int i=1; i<=5; i++) {
-    if (calcParity(data[i]) != (data[i] & 0x80)) {
-      sprintf(output, "Parity failure in byte %d [0x%.2X !~ 0x%.2X]", i, data[i], calcParity(data[i]));
-      return;
-    }
-  }
-
-  // Check checksum.                                                          
-  unsigned char cksum = 0;
-  for (int i=0; i<=5; i++) {
-    cksum += data[i];
-  }
-  if ((cksum & 0xFF) != data[6]) {
-    sprintf(output, "Checksum failure (0x%X vs. 0x%X)", cksum, data[6]);
-    return;
-  }
+public:
+	AcuriteResultsSink( AcuriteCommitScheduler* scheduler, AcuriteAnalyzerResults* results, Channel channel, U64 correlation_window,
+			    U32 marker_mode, U64 run_gap, AcuriteMarkerCount* markers )
+	:	mScheduler( scheduler ), mResults( results ), mChannel( channel ), mCorrelationWindow( correlation_window ),
+		mMarkerMode( marker_mode ), mRunGap( run_gap ), mMarkers( markers ),
+		mCandidate( false ), mCandidateSample( 0 ), mLastDot( ~(U64)0 ), mRunFirst( 0 ), mRunLast( 0 ), mRunCount( 0 ) {}
+
+	virtual void OnMarker( uint64_t sample )
+	{
+		if( mMarkerMode == ACURITE_MARKERS_ALL && mMarkers->mCandidates < ACURITE_MARKER_BUDGET / 2 )
+		{
+			// Don't wait to see whether it's a packet
+			mMarkers->mCandidates++;
+			AddMarker( sample, AnalyzerResults::Dot );
+			mLastDot = sample;
+			return;
+		}
+
+		// Only marked as a packet start if a packet turns up starting here;
+		// the decoder is done with the previous candidate, so that one failed
+		if( mCandidate )
+			Reject( mCandidateSample );
+		mCandidate = true;
+		mCandidateSample = sample;
+	}
 
-  // Data is good! Construct string of data...
+	virtual void OnPacket( const AcuritePacket& decoded )
+	{
+		if( mCandidate && mCandidateSample != decoded.mStartSample )
+			Reject( mCandidateSample );
+		mCandidate = false;
+		EndRun();
+		if( decoded.mStartSample != mLastDot )
+			AddMarker( decoded.mStartSample, AnalyzerResults::Dot );
+
+		AcuritePacket packet = decoded;
+		packet.mFirstCopy = mResults->GetPacketCount();
+		if( mCorrelationWindow != 0 )
+			Correlate( packet );
+
+		// Store the packet; the text is only built when it's displayed
+		Frame frame;
+		frame.mStartingSampleInclusive = packet.mStartSample;
+		frame.mEndingSampleInclusive = packet.mEndSample;
+		frame.mData1 = mResults->AddPacket( packet );
+		frame.mFlags = ( packet.mFlags & ACURITE_PACKET_ERRORS ) ? DISPLAY_AS_ERROR_FLAG : 0;
+
+		AddMarker( packet.mEndSample, AnalyzerResults::Dot );
+		if( frame.mData1 != ACURITE_ARENA_FULL )
+			mResults->AddPacketFrame( frame );
+		mScheduler->Added( frame.mEndingSampleInclusive );
+	}
 
-  // Source A/B/C and ID                                                      
-  output += sprintf(output, "Channel ",  (data[0] & 0xC0) == 0xC0 ? 'A' :
-		    (data[0] & 0xC0) == 0x80 ? 'B' :
-		    (data[0] & 0xC0) == 0x00 ? 'C' :
-		    'x');
+protected:
+	void AddMarker( U64 sample, AnalyzerResults::MarkerType type )
+	{
+		if( mMarkers->mAll >= ACURITE_MARKER_BUDGET )
+			return;
+		mMarkers->mAll++;
+		mResults->AddMarker( sample, type, mChannel );
+	}
 
-  output += sprintf(output, "0x%X ", (data[0] & 0x3F) << 7 | (data[1] & 0x7F));
+	// A candidate frame start that didn't become a packet: it joins the
+	// current run if that ended close enough before it
+	void Reject( U64 sample )
+	{
+		if( mMarkerMode == ACURITE_MARKERS_PACKETS )
+			return;
+
+		if( mRunCount > 0 && sample - mRunLast <= mRunGap )
+		{
+			mRunLast = sample;
+			mRunCount++;
+			return;
+		}
+		EndRun();
+		mRunFirst = sample;
+		mRunLast = sample;
+		mRunCount = 1;
+	}
 
-  output += sprintf(output, "%d%% ", data[3] & 0x7f);
+	// Mark the current run of rejected candidates, if the budget allows
+	void EndRun()
+	{
+		U64 cost = mRunCount > 1 ? 2 : 1;
+		if( mRunCount == 0 || mMarkers->mCandidates + cost > ACURITE_MARKER_BUDGET * 3 / 4 )
+		{
+			mRunCount = 0;
+			return;
+		}
+
+		mMarkers->mCandidates += cost;
+		if( mRunCount == 1 )
+		{
+			AddMarker( mRunFirst, AnalyzerResults::ErrorDot );
+		}
+		else
+		{
+			AddMarker( mRunFirst, AnalyzerResults::Start );
+			AddMarker( mRunLast, AnalyzerResults::Stop );
+		}
+		mRunCount = 0;
+	}
 
-  // Temperature                                                              
-  unsigned long t1 = ((data[4] & 0x0F) << 7) | (data[5] & 0x7F);
-  float temp = ((float)t1 - (float) 1024) / 10.0;
-  output += sprintf(output, "%f C (%f F)", temp, temp * 9.0 / 5.0 + 32.0);
-}
+	// Packets arrive ordered by start sample, so another receiver's copy of
+	// the same transmission is among the last few stored
+	void Correlate( AcuritePacket& packet )
+	{
+		if( packet.mFlags & ACURITE_PACKET_ERRORS )
+			return;
+
+		U64 count = mResults->GetPacketCount();
+		for( U64 i = count; i > 0 && count - i < ACURITE_CORRELATION_LOOKBACK; i-- )
+		{
+			const AcuritePacket& other = mResults->GetPacket( i - 1 );
+			if( other.mStartSample + mCorrelationWindow < packet.mStartSample )
+				break;
+
+			if( ( other.mFlags & ACURITE_PACKET_ERRORS ) == 0 &&
+				( other.mInputMask & packet.mInputMask ) == 0 &&
+				memcmp( other.mData, packet.mData, sizeof packet.mData ) == 0 )
+			{
+				packet.mFirstCopy = other.mFirstCopy;
+				packet.mInputMask |= other.mInputMask;
+				return;
+			}
+		}
+	}
 
+	AcuriteCommitScheduler* mScheduler;
+	AcuriteAnalyzerResults* mResults;
+	Channel mChannel;
+	U64 mCorrelationWindow; // 0: a single input, nothing to correlate
+
+	U32 mMarkerMode;
+	U64 mRunGap; // rejected candidates further apart than this start a new run
+	AcuriteMarkerCount* mMarkers;
+	bool mCandidate; // a frame start yet to be confirmed by a packet
+	U64 mCandidateSample;
+	U64 mLastDot; // last frame start marked as it came in
+	U64 mRunFirst;
+	U64 mRunLast;
+	U64 mRunCount;
+};
 
 void AcuriteAnalyzer::WorkerThread()
 {
-  AcuRiteDecoder decoder;
-  U32 lastPulse = 0;
-  Frame frame; // for saving/printing data
-  frame.mFlags = 0;
-  frame.mStartingSampleInclusive = 0;
-
   mResults.reset( new AcuriteAnalyzerResults( this, mSettings.get() ) );
   SetAnalyzerResults( mResults.get() );
-  mResults->AddChannelBubblesWillAppearOn( mSettings->mInputChannel );
-  
+
   mSampleRateHz = GetSampleRate();
-  log("mSampleRateHz is %lu", mSampleRateHz);
-  mSampleRateMs = mSampleRateHz / 1000000;
-  log("mSampleRateMs is %lu", mSampleRateMs);
-  
-  mSerial = GetAnalyzerChannelData( mSettings->mInputChannel );
+  mResults->SetBurstGap( AcuRiteTiming::atMost( ACURITE_BURST_GAP_US, mSampleRateHz ) );
+  PublishMetrics( AcuriteMetrics() );
+  TRACE(TRACE_PACKET, TRACE_SAMPLE_RATE, mSampleRateHz, 0, 0);
+
+  Channel channels[ ACURITE_MAX_INPUTS ];
+  U32 inputs = mSettings->GetInputChannels( channels );
+  for ( U32 i = 0; i < inputs; i++ )
+    mResults->AddChannelBubblesWillAppearOn( channels[ i ] );
+
+  if ( inputs == 1 )
+    DecodeInput( channels[ 0 ] );
+  else
+    DecodeInputs( channels, inputs );
+}
+
+void AcuriteAnalyzer::DecodeInput( Channel& channel )
+{
+  mSerial = GetAnalyzerChannelData( channel );
+
+  AcuriteMarkerCount markers;
+  AcuriteCommitScheduler scheduler( this, mResults.get(), mSettings->mLatencyMs );
+  AcuriteResultsSink sink( &scheduler, mResults.get(), channel, 0, mSettings->mMarkerMode,
+			   AcuRiteTiming::atLeast( ACURITE_SEGMENT_GAP_US, mSampleRateHz ), &markers );
+  // Decodes on this thread, or collects segments for the decoder threads
+  AcuriteChannelDecoder decoder( GetDecoderOptions(), mSettings->mDecodeThreads );
+  AcuritePreambleSeeker seeker( GetDecoderOptions(), mSettings->mSeekPreambles );
 
-  log("Looking for start low...");
+  mLastPulse = 0;
+  U64 published = 0;
 
   // Have to start on a low pulse...
   if( mSerial->GetBitState() == BIT_HIGH )
     mSerial->AdvanceToNextEdge();
   
   while (1) {
+    // Ship an open segment (or a packet held for repeats) as soon as we
+    // know a gap ends it, rather than when the next burst shows up. An edge
+    // held by the glitch filter goes first, so that can take two rounds.
+    while ( decoder.IsWaiting() &&
+	 !mSerial->WouldAdvancingToAbsPositionCauseTransition( decoder.GetGapEnd() ) ) {
+      decoder.Quiet( decoder.GetGapEnd(), sink );
+
+      // Caught up with a live capture: don't sit on decoded packets
+      if ( !mSerial->DoMoreTransitionsExistInCurrentData() )
+	decoder.Flush( sink );
+    }
+
+    // Or on uncommitted frames while waiting for more data
+    if ( scheduler.IsPending() && !mSerial->DoMoreTransitionsExistInCurrentData() )
+      scheduler.Commit();
+
+    // The metrics go out with the results
+    if ( scheduler.GetCommits() != published ) {
+      AcuriteMetrics metrics;
+      decoder.GetMetrics( metrics );
+      metrics.mSkipped = seeker.GetSkipped();
+      PublishMetrics( metrics );
+      published = scheduler.GetCommits();
+    }
+
     // Find the leading edge
-    log("looking for next leading edge");
     mSerial->AdvanceToNextEdge();
 
-    // Determine the time of this pulse
-    U64 samplepos = mSerial->GetSampleNumber() / mSampleRateMs;
+    U64 samplepos = mSerial->GetSampleNumber();
+    scheduler.Progress( samplepos );
+    if ( !seeker.Keep( mSerial ) ) {
+      // Nothing the decoder sees, so to it the line is still quiet
+      if ( decoder.IsWaiting() )
+	decoder.Quiet( samplepos, sink );
+      continue;
+    }
+
+    decoder.Edge( samplepos, mSerial->GetBitState() == BIT_HIGH, sink );
+    mLastPulse = samplepos;
+  }
+}
+
+// Several receivers: each input is decoded on its own thread. This thread
+// reads all the inputs in step, one quiet-gap-sized window at a time (the
+// SDK's channel data is only read here), and merges what comes back by time.
+void AcuriteAnalyzer::DecodeInputs( Channel* channels, U32 inputs )
+{
+  U64 window = AcuRiteTiming::atLeast( ACURITE_SEGMENT_GAP_US, mSampleRateHz );
+  U64 correlation = AcuRiteTiming::atLeast( ACURITE_CORRELATION_US, mSampleRateHz );
+
+  AnalyzerChannelData* serial[ ACURITE_MAX_INPUTS ];
+  std::unique_ptr< AcuriteChannelThread > decoders[ ACURITE_MAX_INPUTS ];
+  std::unique_ptr< AcuriteResultsSink > sinks[ ACURITE_MAX_INPUTS ];
+  std::vector< AcuritePreambleSeeker > seekers( inputs, AcuritePreambleSeeker( GetDecoderOptions(), mSettings->mSeekPreambles ) );
+  std::vector< U64 > edges[ ACURITE_MAX_INPUTS ]; // read but not yet pushed
+  bool firstHigh[ ACURITE_MAX_INPUTS ] = { false };
+  U64 windowEnd = 0;
+  U64 pendingEdges = 0;
+  U32 pendingWindows = 0;
+  AcuriteMarkerCount markers;
+  AcuriteCommitScheduler scheduler( this, mResults.get(), mSettings->mLatencyMs );
+  U64 published = 0;
+
+  for ( U32 i = 0; i < inputs; i++ ) {
+    serial[ i ] = GetAnalyzerChannelData( channels[ i ] );
+    decoders[ i ].reset( new AcuriteChannelThread( GetDecoderOptions(), i ) );
+    sinks[ i ].reset( new AcuriteResultsSink( &scheduler, mResults.get(), channels[ i ], correlation,
+					      mSettings->mMarkerMode, window, &markers ) );
+
+    // Have to start on a low pulse...
+    if( serial[ i ]->GetBitState() == BIT_HIGH )
+      serial[ i ]->AdvanceToNextEdge();
+    if ( serial[ i ]->GetSampleNumber() > windowEnd )
+      windowEnd = serial[ i ]->GetSampleNumber();
+  }
 
-    if ( (!frame.mStartingSampleInclusive) || 
-	 decoder.state == DecodeOOK::UNKNOWN ) {
-      frame.mStartingSampleInclusive = mSerial->GetSampleNumber();
-      mResults->AddMarker( mSerial->GetSampleNumber(), AnalyzerResults::Dot, mSettings->mInputChannel );
+  while (1) {
+    windowEnd += window;
+
+    bool caughtUp = true;
+    U64 read = 0;
+    for ( U32 i = 0; i < inputs; i++ ) {
+      while ( serial[ i ]->WouldAdvancingToAbsPositionCauseTransition( windowEnd ) ) {
+	serial[ i ]->AdvanceToNextEdge();
+	read++;
+	if ( !seekers[ i ].Keep( serial[ i ] ) )
+	  continue;
+	if ( edges[ i ].empty() )
+	  firstHigh[ i ] = serial[ i ]->GetBitState() == BIT_HIGH;
+	edges[ i ].push_back( serial[ i ]->GetSampleNumber() );
+	pendingEdges++;
+      }
+      caughtUp = caughtUp && !serial[ i ]->DoMoreTransitionsExistInCurrentData();
+    }
+    scheduler.Progress( windowEnd, read + 1 );
+
+    // Hand the decoder threads enough work at a time to be worth waking
+    // them for, but keep the merge moving
+    pendingWindows++;
+    if ( !caughtUp && pendingEdges < ACURITE_INPUT_BATCH_EDGES &&
+	 pendingWindows < ACURITE_INPUT_BATCH_WINDOWS )
+      continue;
+
+    for ( U32 i = 0; i < inputs; i++ )
+      decoders[ i ]->Push( edges[ i ], firstHigh[ i ], windowEnd );
+    pendingEdges = 0;
+    pendingWindows = 0;
+
+    // Caught up with a live capture: don't sit on decoded packets
+    if ( caughtUp )
+      for ( U32 i = 0; i < inputs; i++ )
+	decoders[ i ]->Sync();
+
+    MergeInputs( decoders, sinks, inputs );
+    if ( caughtUp )
+      scheduler.Commit();
+
+    if ( scheduler.GetCommits() != published ) {
+      AcuriteMetrics metrics;
+      for ( U32 i = 0; i < inputs; i++ ) {
+	decoders[ i ]->GetMetrics( metrics );
+	metrics.mSkipped += seekers[ i ].GetSkipped();
+      }
+      PublishMetrics( metrics );
+      published = scheduler.GetCommits();
     }
+  }
+}
 
-    // Pass the pulse to the decoder
-    log("calling decoder.nextPulse(%lu)", (unsigned long)samplepos - lastPulse);
-    if (decoder.nextPulse((unsigned long)samplepos - lastPulse)) {
-      byte size;
-
-      log("nextPulse is now done");
-
-      const byte *data = decoder.getData(size);
-      char output[1024];
-      interpretData(data, size, output);
-      decoder.resetDecoder();
-
-      // Display the data
-      mResults->AddMarker( mSerial->GetSampleNumber(), AnalyzerResults::Dot, mSettings->mInputChannel );
-      frame.mEndingSampleInclusive = mSerial->GetSampleNumber();
-      frame.mData1 = (U64)output; // fixme - this is fugly.
-      mResults->AddFrame( frame );
-      mResults->CommitResults();
-
-      ReportProgress( frame.mEndingSampleInclusive );
-
-      // reset frame for next one
-      frame.mStartingSampleInclusive = 0;
-      
-      // make sure we're at a low level when we're done decoding
-      if ( mSerial->GetBitState() == BIT_HIGH)
-	mSerial->AdvanceToNextEdge();
+AcuriteDecoderOptions AcuriteAnalyzer::GetDecoderOptions()
+{
+  AcuriteDecoderOptions options( mSampleRateHz );
+  options.mRepeatWindowUs = mSettings->mRepeatWindowMs * 1000;
+  options.mCalibrationEdges = mSettings->mCalibrationEdges;
+  options.mCorrectBits = mSettings->mCorrectBits;
+  options.mGlitchWidthUs = mSettings->mGlitchWidthUs;
+  return options;
+}
+
+// Passes on decoder output, oldest first, for as long as no input can still
+// come up with something older.
+void AcuriteAnalyzer::MergeInputs( std::unique_ptr< AcuriteChannelThread >* decoders,
+				   std::unique_ptr< AcuriteResultsSink >* sinks, U32 inputs )
+{
+  while (1) {
+    U64 bound = ~(U64)0;
+    U32 next = inputs;
+    U64 nextKey = ~(U64)0;
+
+    for ( U32 i = 0; i < inputs; i++ ) {
+      U64 key;
+      if ( decoders[ i ]->Peek( key ) ) {
+	if ( key < nextKey ) {
+	  next = i;
+	  nextKey = key;
+	}
+      } else if ( key < bound ) {
+	bound = key;
+      }
     }
 
-    log("Decoder state is now %d", decoder.state);
-    lastPulse = samplepos;
+    if ( next == inputs || nextKey > bound )
+      return;
+    decoders[ next ]->Pop( *sinks[ next ] );
   }
+}
 
+void AcuriteAnalyzer::PublishMetrics( const AcuriteMetrics& metrics )
+{
+	std::lock_guard< std::mutex > lock( mMetricsMutex );
+	mMetrics = metrics;
+}
 
+AcuriteMetrics AcuriteAnalyzer::GetMetrics()
+{
+	std::lock_guard< std::mutex > lock( mMetricsMutex );
+	return mMetrics;
 }
 
 bool AcuriteAnalyzer::NeedsRerun()
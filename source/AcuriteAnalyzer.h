@@ -2,10 +2,18 @@
 #define ACURITE_ANALYZER_H
 
 #include <Analyzer.h>
+#include <memory>
+#include <mutex>
 #include "AcuriteAnalyzerResults.h"
+#include "AcuriteMetrics.h"
 #include "AcuriteSimulationDataGenerator.h"
 
 class AcuriteAnalyzerSettings;
+class AcuriteChannelDecoder;
+class AcuriteChannelThread;
+class AcuritePreambleSeeker;
+class AcuriteResultsSink;
+struct AcuriteDecoderOptions;
 class ANALYZER_EXPORT AcuriteAnalyzer : public Analyzer
 {
 public:
@@ -19,6 +27,16 @@ public:
 	virtual const char* GetAnalyzerName() const;
 	virtual bool NeedsRerun();
 
+	// What the decoders have counted so far, as of the last commit
+	AcuriteMetrics GetMetrics();
+
+protected: //functions
+	AcuriteDecoderOptions GetDecoderOptions();
+	void DecodeInput( Channel& channel );
+	void DecodeInputs( Channel* channels, U32 inputs );
+	void MergeInputs( std::unique_ptr< AcuriteChannelThread >* decoders, std::unique_ptr< AcuriteResultsSink >* sinks, U32 inputs );
+	void PublishMetrics( const AcuriteMetrics& metrics );
+
 protected: //vars
 	std::auto_ptr< AcuriteAnalyzerSettings > mSettings;
 	std::auto_ptr< AcuriteAnalyzerResults > mResults;
@@ -28,9 +46,11 @@ protected: //vars
 	bool mSimulationInitilized;
 
 	//Acurite analysis vars:
-	U32 mLastPulse;
+	U64 mLastPulse; // sample number of the previous edge
 	U32 mSampleRateHz;
-	U32 mSampleRateMs;
+
+	std::mutex mMetricsMutex; // the worker thread publishes, anyone reads
+	AcuriteMetrics mMetrics;
 };
 
 extern "C" ANALYZER_EXPORT const char* __cdecl GetAnalyzerName();
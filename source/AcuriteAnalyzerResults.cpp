@@ -4,12 +4,27 @@
 #include "AcuriteAnalyzerSettings.h"
 #include <iostream>
 #include <fstream>
+#include <string.h>
+
+// Room for AcuriteFormatPacket() and the receiver tags
+#define FRAME_TEXT_SIZE 192
+// ... and AcuriteFormatQuality() after them
+#define TABLE_TEXT_SIZE ( FRAME_TEXT_SIZE + 96 )
 
 AcuriteAnalyzerResults::AcuriteAnalyzerResults( AcuriteAnalyzer* analyzer, AcuriteAnalyzerSettings* settings )
 :	AnalyzerResults(),
 	mSettings( settings ),
-	mAnalyzer( analyzer )
+	mAnalyzer( analyzer ),
+	mBurstGap( 0 ),
+	mBurstFrames( 0 ),
+	mBurstEnd( 0 ),
+	mBurstSensor( -1 )
 {
+	for( U32 i = 0; i < ACURITE_NUM_SENSOR_IDS; i++ )
+	{
+		mSensorLast[ i ].store( ACURITE_ARENA_FULL );
+		mSensorCounts[ i ].store( 0 );
+	}
 }
 
 AcuriteAnalyzerResults::~AcuriteAnalyzerResults()
@@ -21,19 +36,133 @@ void AcuriteAnalyzerResults::GenerateBubbleText( U64 frame_index, Channel& chann
 	ClearResultStrings();
 	Frame frame = GetFrame( frame_index );
 
-	// The data passed in as frame.mData1 is a pointer to a string.
-	// I'm not really happy with that, but it'll do for the moment...
-	AddResultString( (char *)frame.mData1 );
+	// Each receiver's packets only get a bubble on its own channel
+	Channel channels[ ACURITE_MAX_INPUTS ];
+	U32 inputs = mSettings->GetInputChannels( channels );
+	const AcuritePacket& packet = GetPacket( frame.mData1 );
+	if( inputs > 1 && channels[ packet.mInput ] != channel )
+		return;
+
+	char text[128];
+	AcuriteFormatPacket( packet, text );
+	AddResultString( text );
+}
+
+char* AcuriteAnalyzerResults::FormatFrame( const Frame& frame, char* text )
+{
+	Channel channels[ ACURITE_MAX_INPUTS ];
+	const AcuritePacket& packet = GetPacket( frame.mData1 );
+	if( mSettings->GetInputChannels( channels ) == 1 )
+		return text + AcuriteFormatPacket( packet, text );
+
+	char* out = AcuriteFormatText( text, "Rx" );
+	out = AcuriteFormatUnsigned( out, packet.mInput + 1 );
+	*out++ = ' ';
+	out += AcuriteFormatPacket( packet, out );
+
+	// A later copy of a transmission says who else heard it
+	if( packet.mFirstCopy != frame.mData1 )
+	{
+		out = AcuriteFormatText( out, " (copy of #" );
+		out = AcuriteFormatUnsigned( out, packet.mFirstCopy );
+		out = AcuriteFormatText( out, ", heard on" );
+		for( U32 i = 0; i < ACURITE_MAX_INPUTS; i++ )
+		{
+			if( packet.mInputMask & ( 1 << i ) )
+			{
+				out = AcuriteFormatText( out, " Rx" );
+				out = AcuriteFormatUnsigned( out, i + 1 );
+			}
+		}
+		*out++ = ')';
+	}
+	*out = 0;
+	return out;
+}
+
+void AcuriteAnalyzerResults::AddPacketFrame( const Frame& frame )
+{
+	const AcuritePacket& packet = GetPacket( frame.mData1 );
+	bool valid = !( packet.mFlags & ACURITE_PACKET_ERRORS );
+
+	// Another sensor's packet ends the burst, even if the two overlap
+	if( mBurstFrames > 0 && ( (U64)frame.mStartingSampleInclusive > mBurstEnd + mBurstGap ||
+		( valid && mBurstSensor >= 0 && packet.mSensorId != mBurstSensor ) ) )
+		CommitBurst();
+
+	AddFrame( frame );
+	if( mBurstFrames++ == 0 || (U64)frame.mEndingSampleInclusive > mBurstEnd )
+		mBurstEnd = frame.mEndingSampleInclusive;
+	if( valid && mBurstSensor < 0 )
+		mBurstSensor = packet.mSensorId;
+	if( valid )
+		mSensorsAdded.push_back( packet.mSensorId );
+}
+
+bool AcuriteAnalyzerResults::EndBurst( U64 sample )
+{
+	if( mBurstFrames == 0 || sample <= mBurstEnd + mBurstGap )
+		return false;
+	CommitBurst();
+	return true;
+}
+
+void AcuriteAnalyzerResults::Commit()
+{
+	CommitResults();
+
+	for( size_t i = 0; i < mSensorsAdded.size(); i++ )
+	{
+		U16 id = mSensorsAdded[ i ];
+		mSensorLast[ id ].store( mPackets.GetLastFromSensor( id ), std::memory_order_release );
+		mSensorCounts[ id ].store( mPackets.GetSensorPacketCount( id ), std::memory_order_release );
+	}
+	mSensorsAdded.clear();
+}
+
+void AcuriteAnalyzerResults::CommitBurst()
+{
+	U64 packet_id = CommitPacketAndStartNewPacket();
+	if( mBurstSensor >= 0 )
+		AddPacketToTransaction( mBurstSensor, packet_id );
+	mBurstFrames = 0;
+	mBurstSensor = -1;
+}
+
+// A CSV field: quoted, with its quotes doubled, if it holds a comma or a quote
+static void WriteCsvField( std::ofstream& file_stream, const char* text )
+{
+	if( strpbrk( text, ",\"" ) == NULL )
+	{
+		file_stream << text;
+		return;
+	}
+
+	file_stream << '"';
+	for( const char* c = text; *c != 0; c++ )
+	{
+		if( *c == '"' )
+			file_stream << '"';
+		file_stream << *c;
+	}
+	file_stream << '"';
 }
 
 void AcuriteAnalyzerResults::GenerateExportFile( const char* file, DisplayBase display_base, U32 export_type_user_id )
 {
 	std::ofstream file_stream( file, std::ios::out );
 
+	if( export_type_user_id == ACURITE_EXPORT_METRICS )
+	{
+		mAnalyzer->GetMetrics().Print( file_stream );
+		file_stream.close();
+		return;
+	}
+
 	U64 trigger_sample = mAnalyzer->GetTriggerSample();
 	U32 sample_rate = mAnalyzer->GetSampleRate();
 
-	file_stream << "Time [s],Value" << std::endl;
+	file_stream << "Time [s],Value,Syncs,Copy,Mean deviation [uS],Max deviation [uS],Min margin [uS]" << std::endl;
 
 	U64 num_frames = GetNumFrames();
 	for( U32 i=0; i < num_frames; i++ )
@@ -43,10 +172,14 @@ void AcuriteAnalyzerResults::GenerateExportFile( const char* file, DisplayBase d
 		char time_str[128];
 		AnalyzerHelpers::GetTimeString( frame.mStartingSampleInclusive, trigger_sample, sample_rate, time_str, 128 );
 
-		char number_str[128];
-		AnalyzerHelpers::GetNumberString( frame.mData1, display_base, 8, number_str, 128 );
+		char text[ FRAME_TEXT_SIZE ];
+		FormatFrame( frame, text );
 
-		file_stream << time_str << "," << number_str << std::endl;
+		const AcuritePacket& packet = GetPacket( frame.mData1 );
+		file_stream << time_str << ",";
+		WriteCsvField( file_stream, text );
+		file_stream << "," << (unsigned)packet.mSyncs << "," << packet.mCopy + 1 << ","
+			<< packet.mMeanDeviation << "," << packet.mMaxDeviation << "," << packet.mMinMargin << std::endl;
 
 		if( UpdateExportProgressAndCheckForCancel( i, num_frames ) == true )
 		{
@@ -63,19 +196,67 @@ void AcuriteAnalyzerResults::GenerateFrameTabularText( U64 frame_index, DisplayB
 	Frame frame = GetFrame( frame_index );
 	ClearResultStrings();
 
-	char number_str[128];
-	AnalyzerHelpers::GetNumberString( frame.mData1, display_base, 8, number_str, 128 );
-	AddResultString( number_str );
+	char text[ TABLE_TEXT_SIZE ];
+	char* end = FormatFrame( frame, text );
+	end = AcuriteFormatText( end, "; " );
+	AcuriteFormatQuality( GetPacket( frame.mData1 ), end );
+	AddResultString( text );
 }
 
+// A transmission burst: what its first good copy says, and how many of
+// its frames were good
 void AcuriteAnalyzerResults::GeneratePacketTabularText( U64 packet_id, DisplayBase display_base )
 {
 	ClearResultStrings();
-	AddResultString( "not supported" );
+
+	U64 first_frame;
+	U64 last_frame;
+	GetFramesContainedInPacket( packet_id, &first_frame, &last_frame );
+
+	U64 reading = ACURITE_ARENA_FULL;
+	U64 good = 0;
+	for( U64 i = first_frame; i <= last_frame; i++ )
+	{
+		U64 index = GetFrame( i ).mData1;
+		if( GetPacket( index ).mFlags & ACURITE_PACKET_ERRORS )
+			continue;
+		if( good++ == 0 )
+			reading = index;
+	}
+
+	char text[ TABLE_TEXT_SIZE ];
+	char* end = text;
+	if( reading != ACURITE_ARENA_FULL )
+		end += AcuriteFormatPacket( GetPacket( reading ), end );
+	else
+		end = AcuriteFormatText( end, "No good copy" );
+	end = AcuriteFormatText( end, "; " );
+	end = AcuriteFormatUnsigned( end, good );
+	end = AcuriteFormatText( end, " of " );
+	end = AcuriteFormatUnsigned( end, last_frame - first_frame + 1 );
+	end = AcuriteFormatText( end, " frames good" );
+	*end = 0;
+	AddResultString( text );
 }
 
+// A sensor: how often it's been heard, and its latest reading
 void AcuriteAnalyzerResults::GenerateTransactionTabularText( U64 transaction_id, DisplayBase display_base )
 {
 	ClearResultStrings();
-	AddResultString( "not supported" );
+	U64 latest = transaction_id < ACURITE_NUM_SENSOR_IDS ? GetLastFromSensor( (U16)transaction_id ) : ACURITE_ARENA_FULL;
+	if( latest == ACURITE_ARENA_FULL )
+	{
+		AddResultString( "No readings" );
+		return;
+	}
+
+	U16 id = (U16)transaction_id;
+	char text[ TABLE_TEXT_SIZE ];
+	char* end = AcuriteFormatText( text, "Sensor 0x" );
+	end = AcuriteFormatHex( end, id, 1 );
+	end = AcuriteFormatText( end, ": " );
+	end = AcuriteFormatUnsigned( end, GetSensorPacketCount( id ) );
+	end = AcuriteFormatText( end, " frames, latest " );
+	AcuriteFormatPacket( GetPacket( latest ), end );
+	AddResultString( text );
 }
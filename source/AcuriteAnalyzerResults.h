@@ -2,6 +2,9 @@
 #define ACURITE_ANALYZER_RESULTS
 
 #include <AnalyzerResults.h>
+#include <atomic>
+#include <vector>
+#include "AcuritePacket.h"
 
 class AcuriteAnalyzer;
 class AcuriteAnalyzerSettings;
@@ -19,11 +22,50 @@ public:
 	virtual void GeneratePacketTabularText( U64 packet_id, DisplayBase display_base );
 	virtual void GenerateTransactionTabularText( U64 transaction_id, DisplayBase display_base );
 
+	// Decoded packets; a frame's mData1 is its packet's index here.
+	U64 AddPacket( const AcuritePacket& packet ) { return mPackets.Add( packet ); }
+	const AcuritePacket& GetPacket( U64 index ) const { return mPackets.Get( index ); }
+	U64 GetPacketCount() const { return mPackets.GetCount(); }
+	// A sensor's latest valid packet (ACURITE_ARENA_FULL if none) and how
+	// many there are, as of the last Commit(); safe from any thread. Follow
+	// AcuritePacket::mPreviousFromSensor from there for the rest, newest first.
+	U64 GetLastFromSensor( U16 id ) const { return mSensorLast[ id ].load( std::memory_order_acquire ); }
+	U64 GetSensorPacketCount( U16 id ) const { return mSensorCounts[ id ].load( std::memory_order_acquire ); }
+
+	// Adds the frame of a stored packet, in time order. Frames are grouped
+	// into a Saleae packet per transmission burst, and those into a
+	// transaction per sensor, with the sensor ID as its ID.
+	void AddPacketFrame( const Frame& frame );
+	// Nothing starting after sample can belong to the open burst any more:
+	// commit it as a packet. Returns true if there was one.
+	bool EndBurst( U64 sample );
+	// Copies of a burst follow each other within this many samples (see ACURITE_BURST_GAP_US)
+	void SetBurstGap( U64 samples ) { mBurstGap = samples; }
+
+	// CommitResults(), then bring the sensor index the GUI sees up to date,
+	// so it never points at a frame that isn't committed yet
+	void Commit();
+
 protected: //functions
+	// AcuriteFormatPacket(), plus which receiver heard it when there are
+	// several; returns the end of the text
+	char* FormatFrame( const Frame& frame, char* text );
+	void CommitBurst();
 
 protected:  //vars
+	AcuritePacketArena mPackets;
 	AcuriteAnalyzerSettings* mSettings;
 	AcuriteAnalyzer* mAnalyzer;
+
+	U64 mBurstGap;
+	U64 mBurstFrames; // in the open burst, not yet committed as a packet
+	U64 mBurstEnd;    // its latest frame end
+	int mBurstSensor; // its sensor, once a valid copy says; -1 until then
+
+	// mPackets' sensor index as of the last Commit(), for the GUI thread
+	std::atomic< U64 > mSensorLast[ ACURITE_NUM_SENSOR_IDS ];
+	std::atomic< U64 > mSensorCounts[ ACURITE_NUM_SENSOR_IDS ];
+	std::vector< U16 > mSensorsAdded; // sensors with frames since then
 };
 
 #endif //ACURITE_ANALYZER_RESULTS
@@ -1,19 +1,103 @@
 #include "AcuriteAnalyzerSettings.h"
 #include <AnalyzerHelpers.h>
+#include <stdio.h>
+#include "AcuriteEdgeDecoder.h"
+#include "AcuriteGlitchFilter.h"
+#include "AcuriteCommitScheduler.h"
 
 
 AcuriteAnalyzerSettings::AcuriteAnalyzerSettings()
-:	mInputChannel( UNDEFINED_CHANNEL )
+:	mInputChannel( UNDEFINED_CHANNEL ),
+	mDecodeThreads( 1 ),
+	mRepeatWindowMs( 0 ),
+	mCalibrationEdges( 0 ),
+	mCorrectBits( false ),
+	mGlitchWidthUs( 0 ),
+	mSeekPreambles( false ),
+	mMarkerMode( ACURITE_MARKERS_PACKETS ),
+	mLatencyMs( ACURITE_DEFAULT_LATENCY_MS )
 {
 	mInputChannelInterface.reset( new AnalyzerSettingInterfaceChannel() );
 	mInputChannelInterface->SetTitleAndTooltip( "Serial", "Standard Acurite" );
 	mInputChannelInterface->SetChannel( mInputChannel );
 
-	AddInterface( mInputChannelInterface.get() );
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+	{
+		char title[ 32 ];
+		sprintf( title, "Serial %u", i + 2 );
+
+		mExtraInputChannels[ i ] = UNDEFINED_CHANNEL;
+		mExtraInputChannelInterfaces[ i ].reset( new AnalyzerSettingInterfaceChannel() );
+		mExtraInputChannelInterfaces[ i ]->SetTitleAndTooltip( title, "Another receiver's output, decoded alongside the first (optional)" );
+		mExtraInputChannelInterfaces[ i ]->SetChannel( mExtraInputChannels[ i ] );
+		mExtraInputChannelInterfaces[ i ]->SetSelectionOfNoneIsAllowed( true );
+	}
+
+	mDecodeThreadsInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mDecodeThreadsInterface->SetTitleAndTooltip( "Decoder threads", "Threads decoding the capture in parallel, split at quiet gaps. 1 decodes on the analyzer thread. With several receivers, each one gets its own thread instead." );
+	mDecodeThreadsInterface->SetMin( 1 );
+	mDecodeThreadsInterface->SetMax( 64 );
+	mDecodeThreadsInterface->SetInteger( mDecodeThreads );
+
+	mRepeatWindowInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mRepeatWindowInterface->SetTitleAndTooltip( "Repeat window (ms)", "Sensors send each reading several times. Copies starting within this long of the previous one are shown as a single frame with a count. 0 shows every copy." );
+	mRepeatWindowInterface->SetMin( 0 );
+	mRepeatWindowInterface->SetMax( ACURITE_MAX_REPEAT_WINDOW_US / 1000 );
+	mRepeatWindowInterface->SetInteger( mRepeatWindowMs );
+
+	mCalibrationEdgesInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mCalibrationEdgesInterface->SetTitleAndTooltip( "Calibration edges", "Fit the pulse-width thresholds to this many edges from the start of the capture, for sensors whose timing has drifted; nothing is shown until they've come in. 0 uses the fixed thresholds." );
+	mCalibrationEdgesInterface->SetMin( 0 );
+	mCalibrationEdgesInterface->SetMax( ACURITE_MAX_CALIBRATION_EDGES );
+	mCalibrationEdgesInterface->SetInteger( mCalibrationEdges );
+
+	mCorrectBitsInterface.reset( new AnalyzerSettingInterfaceBool() );
+	mCorrectBitsInterface->SetTitleAndTooltip( "", "A packet whose parity or checksum is out by one bit is repaired by flipping the bit that was read least clearly, and marked as corrected." );
+	mCorrectBitsInterface->SetCheckBoxText( "Correct single-bit errors" );
+	mCorrectBitsInterface->SetValue( mCorrectBits );
+
+	mGlitchWidthInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mGlitchWidthInterface->SetTitleAndTooltip( "Glitch filter (uS)", "Pulses shorter than this are noise: they're dropped, along with the edges either side of them, before decoding. Speeds up noisy captures a lot. 0 keeps every pulse." );
+	mGlitchWidthInterface->SetMin( 0 );
+	mGlitchWidthInterface->SetMax( ACURITE_GLITCH_MAX_US );
+	mGlitchWidthInterface->SetInteger( mGlitchWidthUs );
+
+	mSeekPreamblesInterface.reset( new AnalyzerSettingInterfaceBool() );
+	mSeekPreamblesInterface->SetTitleAndTooltip( "", "Only decode from pulses long enough to be a sync bit until their packet would be over. Noise between packets is stepped over without being decoded or marked, which speeds up noisy captures." );
+	mSeekPreamblesInterface->SetCheckBoxText( "Skip to sync preambles" );
+	mSeekPreamblesInterface->SetValue( mSeekPreambles );
+
+	mMarkerModeInterface.reset( new AnalyzerSettingInterfaceNumberList() );
+	mMarkerModeInterface->SetTitleAndTooltip( "Markers", "Where frames that didn't decode into a packet are marked. On a noisy channel that can be nearly every edge, so they're coalesced into ranges once there are too many." );
+	mMarkerModeInterface->AddNumber( ACURITE_MARKERS_PACKETS, "Packets only", "A marker at the start and end of each packet, nothing else" );
+	mMarkerModeInterface->AddNumber( ACURITE_MARKERS_RANGES, "Rejected runs as ranges", "Frames that started and failed close together are marked as one range" );
+	mMarkerModeInterface->AddNumber( ACURITE_MARKERS_ALL, "Every frame start", "A dot wherever a frame started, packet or not" );
+	mMarkerModeInterface->SetNumber( mMarkerMode );
+
+	mLatencyInterface.reset( new AnalyzerSettingInterfaceInteger() );
+	mLatencyInterface->SetTitleAndTooltip( "Display latency (ms)", "New frames are shown in batches, at the latest this long after they're decoded, which is what a live capture waits for them. 0 shows each one as soon as it's decoded, which slows down long captures." );
+	mLatencyInterface->SetMin( 0 );
+	mLatencyInterface->SetMax( ACURITE_MAX_LATENCY_MS );
+	mLatencyInterface->SetInteger( mLatencyMs );
 
-	AddExportOption( 0, "Export as text/csv file" );
-	AddExportExtension( 0, "text", "txt" );
-	AddExportExtension( 0, "csv", "csv" );
+	AddInterface( mInputChannelInterface.get() );
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		AddInterface( mExtraInputChannelInterfaces[ i ].get() );
+	AddInterface( mDecodeThreadsInterface.get() );
+	AddInterface( mRepeatWindowInterface.get() );
+	AddInterface( mCalibrationEdgesInterface.get() );
+	AddInterface( mCorrectBitsInterface.get() );
+	AddInterface( mGlitchWidthInterface.get() );
+	AddInterface( mSeekPreamblesInterface.get() );
+	AddInterface( mMarkerModeInterface.get() );
+	AddInterface( mLatencyInterface.get() );
+
+	AddExportOption( ACURITE_EXPORT_FRAMES, "Export as text/csv file" );
+	AddExportExtension( ACURITE_EXPORT_FRAMES, "text", "txt" );
+	AddExportExtension( ACURITE_EXPORT_FRAMES, "csv", "csv" );
+	AddExportOption( ACURITE_EXPORT_METRICS, "Export decoder metrics" );
+	AddExportExtension( ACURITE_EXPORT_METRICS, "text", "txt" );
+	AddExportExtension( ACURITE_EXPORT_METRICS, "csv", "csv" );
 
 	ClearChannels();
 	AddChannel( mInputChannel, "Serial", false );
@@ -25,10 +109,32 @@ AcuriteAnalyzerSettings::~AcuriteAnalyzerSettings()
 
 bool AcuriteAnalyzerSettings::SetSettingsFromInterfaces()
 {
-	mInputChannel = mInputChannelInterface->GetChannel();
-
-	ClearChannels();
-	AddChannel( mInputChannel, "Acurite", true );
+	Channel channels[ ACURITE_MAX_INPUTS ];
+	channels[ 0 ] = mInputChannelInterface->GetChannel();
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		channels[ i + 1 ] = mExtraInputChannelInterfaces[ i ]->GetChannel();
+
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS; i++ )
+		for( U32 j = i + 1; j < ACURITE_MAX_INPUTS; j++ )
+			if( channels[ j ] != UNDEFINED_CHANNEL && channels[ i ] == channels[ j ] )
+			{
+				SetErrorText( "Each receiver needs its own channel." );
+				return false;
+			}
+
+	mInputChannel = channels[ 0 ];
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		mExtraInputChannels[ i ] = channels[ i + 1 ];
+	mDecodeThreads = mDecodeThreadsInterface->GetInteger();
+	mRepeatWindowMs = mRepeatWindowInterface->GetInteger();
+	mCalibrationEdges = mCalibrationEdgesInterface->GetInteger();
+	mCorrectBits = mCorrectBitsInterface->GetValue();
+	mGlitchWidthUs = mGlitchWidthInterface->GetInteger();
+	mSeekPreambles = mSeekPreamblesInterface->GetValue();
+	mMarkerMode = U32( mMarkerModeInterface->GetNumber() );
+	mLatencyMs = mLatencyInterface->GetInteger();
+
+	UpdateChannels();
 
 	return true;
 }
@@ -36,6 +142,34 @@ bool AcuriteAnalyzerSettings::SetSettingsFromInterfaces()
 void AcuriteAnalyzerSettings::UpdateInterfacesFromSettings()
 {
 	mInputChannelInterface->SetChannel( mInputChannel );
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		mExtraInputChannelInterfaces[ i ]->SetChannel( mExtraInputChannels[ i ] );
+	mDecodeThreadsInterface->SetInteger( mDecodeThreads );
+	mRepeatWindowInterface->SetInteger( mRepeatWindowMs );
+	mCalibrationEdgesInterface->SetInteger( mCalibrationEdges );
+	mCorrectBitsInterface->SetValue( mCorrectBits );
+	mGlitchWidthInterface->SetInteger( mGlitchWidthUs );
+	mSeekPreamblesInterface->SetValue( mSeekPreambles );
+	mMarkerModeInterface->SetNumber( mMarkerMode );
+	mLatencyInterface->SetInteger( mLatencyMs );
+}
+
+void AcuriteAnalyzerSettings::UpdateChannels()
+{
+	ClearChannels();
+	AddChannel( mInputChannel, "Acurite", true );
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		AddChannel( mExtraInputChannels[ i ], "Acurite", mExtraInputChannels[ i ] != UNDEFINED_CHANNEL );
+}
+
+U32 AcuriteAnalyzerSettings::GetInputChannels( Channel* channels ) const
+{
+	U32 count = 0;
+	channels[ count++ ] = mInputChannel;
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		if( mExtraInputChannels[ i ] != UNDEFINED_CHANNEL )
+			channels[ count++ ] = mExtraInputChannels[ i ];
+	return count;
 }
 
 void AcuriteAnalyzerSettings::LoadSettings( const char* settings )
@@ -45,8 +179,28 @@ void AcuriteAnalyzerSettings::LoadSettings( const char* settings )
 
 	text_archive >> mInputChannel;
 
-	ClearChannels();
-	AddChannel( mInputChannel, "Acurite", true );
+	// Settings saved before this option existed don't have it
+	if( !( text_archive >> mDecodeThreads ) || mDecodeThreads < 1 )
+		mDecodeThreads = 1;
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		if( !( text_archive >> mExtraInputChannels[ i ] ) )
+			mExtraInputChannels[ i ] = UNDEFINED_CHANNEL;
+	if( !( text_archive >> mRepeatWindowMs ) || mRepeatWindowMs > ACURITE_MAX_REPEAT_WINDOW_US / 1000 )
+		mRepeatWindowMs = 0;
+	if( !( text_archive >> mCalibrationEdges ) || mCalibrationEdges > ACURITE_MAX_CALIBRATION_EDGES )
+		mCalibrationEdges = 0;
+	if( !( text_archive >> mCorrectBits ) )
+		mCorrectBits = false;
+	if( !( text_archive >> mGlitchWidthUs ) || mGlitchWidthUs > ACURITE_GLITCH_MAX_US )
+		mGlitchWidthUs = 0;
+	if( !( text_archive >> mSeekPreambles ) )
+		mSeekPreambles = false;
+	if( !( text_archive >> mMarkerMode ) || mMarkerMode > ACURITE_MARKERS_ALL )
+		mMarkerMode = ACURITE_MARKERS_PACKETS;
+	if( !( text_archive >> mLatencyMs ) || mLatencyMs > ACURITE_MAX_LATENCY_MS )
+		mLatencyMs = ACURITE_DEFAULT_LATENCY_MS;
+
+	UpdateChannels();
 
 	UpdateInterfacesFromSettings();
 }
@@ -56,6 +210,16 @@ const char* AcuriteAnalyzerSettings::SaveSettings()
 	SimpleArchive text_archive;
 
 	text_archive << mInputChannel;
+	text_archive << mDecodeThreads;
+	for( U32 i = 0; i < ACURITE_MAX_INPUTS - 1; i++ )
+		text_archive << mExtraInputChannels[ i ];
+	text_archive << mRepeatWindowMs;
+	text_archive << mCalibrationEdges;
+	text_archive << mCorrectBits;
+	text_archive << mGlitchWidthUs;
+	text_archive << mSeekPreambles;
+	text_archive << mMarkerMode;
+	text_archive << mLatencyMs;
 
 	return SetReturnString( text_archive.GetString() );
 }
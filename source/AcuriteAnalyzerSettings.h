@@ -4,6 +4,33 @@
 #include <AnalyzerSettings.h>
 #include <AnalyzerTypes.h>
 
+// Receivers that can be decoded together: mInputChannel plus the extras
+#define ACURITE_MAX_INPUTS 4
+
+// Edges held back for calibration at most
+#define ACURITE_MAX_CALIBRATION_EDGES 1000000
+
+// Export options
+#define ACURITE_EXPORT_FRAMES 0  // every frame's text, with its time
+#define ACURITE_EXPORT_METRICS 1 // AcuriteMetrics::Print()
+
+// What gets a marker: packets always get one at each end, candidate frame
+// starts that don't become packets depend on the mode
+enum AcuriteMarkerMode
+{
+	ACURITE_MARKERS_PACKETS, // none
+	ACURITE_MARKERS_RANGES,  // runs of them, as one Start/Stop range each
+	ACURITE_MARKERS_ALL      // a dot each
+};
+
+// Markers per capture at most. Rejected candidates get a dot each until
+// they've used half of it, then are coalesced into ranges up to three
+// quarters; the rest is kept for packets.
+#define ACURITE_MARKER_BUDGET 100000
+
+// How long new frames may wait to be shown, unless set otherwise
+#define ACURITE_DEFAULT_LATENCY_MS 250
+
 class AcuriteAnalyzerSettings : public AnalyzerSettings
 {
 public:
@@ -15,11 +42,33 @@ public:
 	virtual void LoadSettings( const char* settings );
 	virtual const char* SaveSettings();
 
+	// The channels in use, mInputChannel first; returns how many.
+	U32 GetInputChannels( Channel* channels ) const;
 	
 	Channel mInputChannel;
+	Channel mExtraInputChannels[ ACURITE_MAX_INPUTS - 1 ]; // UNDEFINED_CHANNEL when unused
+	U32 mDecodeThreads; // 1: decode on the analyzer thread
+	U32 mRepeatWindowMs; // fold repeated copies of a packet; 0: show them all
+	U32 mCalibrationEdges; // fit the thresholds to this many edges first; 0: fixed thresholds
+	bool mCorrectBits; // repair packets that are one bit off
+	U32 mGlitchWidthUs; // drop shorter pulses before decoding; 0: keep them all
+	bool mSeekPreambles; // only decode from pulses that could be sync bits
+	U32 mMarkerMode; // an AcuriteMarkerMode
+	U32 mLatencyMs; // commit frames at least this often; 0: each one as it comes
 
 protected:
+	void UpdateChannels();
+
 	std::auto_ptr< AnalyzerSettingInterfaceChannel >	mInputChannelInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceChannel >	mExtraInputChannelInterfaces[ ACURITE_MAX_INPUTS - 1 ];
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mDecodeThreadsInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mRepeatWindowInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mCalibrationEdgesInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceBool >		mCorrectBitsInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mGlitchWidthInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceBool >		mSeekPreamblesInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceNumberList >	mMarkerModeInterface;
+	std::auto_ptr< AnalyzerSettingInterfaceInteger >	mLatencyInterface;
 };
 
 #endif //ACURITE_ANALYZER_SETTINGS
@@ -0,0 +1,157 @@
+#include "AcuriteCalibration.h"
+#include "AcuriteSimulationTiming.h"
+#include <math.h>
+#include <string.h>
+
+// Rounds of re-centering; the clusters settle in two or three
+#define CLUSTER_ITERATIONS 8
+// Around a cluster's peak, how far its own pulses spread
+#define CLUSTER_PEAK_REACH 0.08
+
+AcuriteCalibrator::AcuriteCalibrator( uint32_t sample_rate_hz )
+:	mSampleRateHz( sample_rate_hz ),
+	mMaxWidth( AcuRiteTiming::atMost( BIT_WIDTH, sample_rate_hz ) )
+{
+	memset( &mHigh, 0, sizeof mHigh );
+	memset( &mLow, 0, sizeof mLow );
+}
+
+void AcuriteCalibrator::Pulse( uint64_t width, bool high )
+{
+	if( width == 0 || width > mMaxWidth )
+		return;
+
+	uint64_t bin = width * 1000000 / ( (uint64_t)mSampleRateHz * ACURITE_CALIBRATION_BIN_US );
+	if( bin >= ACURITE_CALIBRATION_BINS )
+		return;
+
+	Histogram& histogram = high ? mHigh : mLow;
+	histogram.mCount[ bin ]++;
+	histogram.mSum[ bin ] += width;
+}
+
+bool AcuriteCalibrator::Cluster( const Histogram& histogram, double* centers, int count ) const
+{
+	int nearest[ ACURITE_CALIBRATION_BINS ];
+	int peaks[ 4 ];
+
+	for( int iteration = 0; iteration < CLUSTER_ITERATIONS; iteration++ )
+	{
+		double sums[ 4 ] = { 0 };
+		uint64_t pulses[ 4 ] = { 0 };
+
+		for( int bin = 0; bin < ACURITE_CALIBRATION_BINS; bin++ )
+		{
+			nearest[ bin ] = -1;
+			if( histogram.mCount[ bin ] == 0 )
+				continue;
+
+			// The nearest center, if it's near enough
+			double width = (double)histogram.mSum[ bin ] / histogram.mCount[ bin ];
+			int c = 0;
+			for( int i = 1; i < count; i++ )
+				if( fabs( width - centers[ i ] ) < fabs( width - centers[ c ] ) )
+					c = i;
+			if( fabs( width - centers[ c ] ) > centers[ c ] * ACURITE_CALIBRATION_MAX_DRIFT )
+				continue;
+
+			nearest[ bin ] = c;
+			sums[ c ] += histogram.mSum[ bin ];
+			pulses[ c ] += histogram.mCount[ bin ];
+		}
+
+		bool moved = false;
+		for( int c = 0; c < count; c++ )
+		{
+			if( pulses[ c ] < ACURITE_CALIBRATION_MIN_PULSES )
+				return false;
+
+			double center = sums[ c ] / pulses[ c ];
+			moved |= fabs( center - centers[ c ] ) >= 0.5;
+			centers[ c ] = center;
+		}
+		if( !moved )
+			break;
+	}
+
+	// Noise spread over a cluster's range pulls its mean toward the middle
+	// of the range; the sensor's pulses are the peak, so settle on that.
+	for( int c = 0; c < count; c++ )
+		peaks[ c ] = -1;
+	for( int bin = 0; bin < ACURITE_CALIBRATION_BINS; bin++ )
+	{
+		int c = nearest[ bin ];
+		if( c >= 0 && ( peaks[ c ] < 0 || histogram.mCount[ bin ] > histogram.mCount[ peaks[ c ] ] ) )
+			peaks[ c ] = bin;
+	}
+
+	for( int c = 0; c < count; c++ )
+	{
+		double peak = (double)histogram.mSum[ peaks[ c ] ] / histogram.mCount[ peaks[ c ] ];
+		double sum = 0;
+		uint64_t pulses = 0;
+		for( int bin = 0; bin < ACURITE_CALIBRATION_BINS; bin++ )
+		{
+			if( nearest[ bin ] != c )
+				continue;
+			double width = (double)histogram.mSum[ bin ] / histogram.mCount[ bin ];
+			if( fabs( width - peak ) <= peak * CLUSTER_PEAK_REACH )
+			{
+				sum += histogram.mSum[ bin ];
+				pulses += histogram.mCount[ bin ];
+			}
+		}
+
+		if( pulses < ACURITE_CALIBRATION_MIN_PULSES )
+			return false;
+		centers[ c ] = sum / pulses;
+	}
+	return true;
+}
+
+bool AcuriteCalibrator::Calibrate( AcuRiteTiming& timing ) const
+{
+	double us = mSampleRateHz / 1000000.0; // samples per uS
+
+	enum { ZERO, ONE, SYNC };
+	double high[ 3 ] = { ZEROHIGH * us, ONEHIGH * us, SYNCHIGH * us };
+	double low[ 3 ] = { ONELOW * us, ZEROLOW * us, SYNCLOW * us };
+	if( !Cluster( mHigh, high, 3 ) || !Cluster( mLow, low, 3 ) )
+		return false;
+
+	// How far each class is from nominal
+	double zero = high[ ZERO ] / ( ZEROHIGH * us );
+	double one = high[ ONE ] / ( ONEHIGH * us );
+	double sync_high = high[ SYNC ] / ( SYNCHIGH * us );
+	double sync_low = low[ SYNC ] / ( SYNCLOW * us );
+
+	double drifts[] = { zero, one, sync_high, sync_low };
+	double longest = 0;
+	for( int i = 0; i < 4; i++ )
+	{
+		if( fabs( drifts[ i ] - 1 ) > ACURITE_CALIBRATION_MAX_DRIFT )
+			return false;
+		if( drifts[ i ] > longest )
+			longest = drifts[ i ];
+	}
+
+	// The low half of a sync bit has to be a SYNC width too, so the sync
+	// limits follow the sync highs and lows both. Rounded as AcuRiteTiming
+	// does: ">=" limits up, ">" limits down.
+	AcuRiteTiming fitted( mSampleRateHz );
+	fitted.zeroWidth = (word)ceil( ZERO_WIDTH * us * zero );
+	fitted.oneWidth = (word)ceil( ONE_WIDTH * us * one );
+	fitted.syncWidth = (word)ceil( SYNC_WIDTH * us * ( sync_high < sync_low ? sync_high : sync_low ) );
+	fitted.maxSyncWidth = (word)floor( MAX_SYNC_WIDTH * us * sync_low );
+	fitted.bitWidth = (word)floor( BIT_WIDTH * us * longest );
+
+	// Each cluster has to land in its own class
+	if( !( fitted.zeroWidth <= high[ ZERO ] && high[ ZERO ] < fitted.oneWidth &&
+		   fitted.oneWidth <= high[ ONE ] && high[ ONE ] < fitted.syncWidth && fitted.syncWidth <= high[ SYNC ] &&
+		   fitted.syncWidth <= low[ SYNC ] && low[ SYNC ] <= fitted.maxSyncWidth &&
+		   high[ SYNC ] <= fitted.bitWidth ) )
+		return false;
+
+	timing = fitted;
+	return true;
+}
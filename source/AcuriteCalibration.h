@@ -0,0 +1,50 @@
+#ifndef ACURITE_CALIBRATION_H
+#define ACURITE_CALIBRATION_H
+
+#include <stdint.h>
+#include "decoders.h"
+
+// Histogram bins, uS wide, up to BIT_WIDTH; anything longer isn't counted
+#define ACURITE_CALIBRATION_BIN_US 4
+#define ACURITE_CALIBRATION_BINS ( BIT_WIDTH / ACURITE_CALIBRATION_BIN_US + 1 )
+// Every class needs at least this many pulses before its width is trusted
+#define ACURITE_CALIBRATION_MIN_PULSES 16
+// How far a sensor's timing may be off before it's not taken for an AcuRite at all
+#define ACURITE_CALIBRATION_MAX_DRIFT 0.3
+
+// Fits AcuRiteDecoder's thresholds to a capture. The widths of the pulses at
+// its start go into histograms, one for high pulses and one for low ones;
+// those are clustered around the widths a sensor sends (see
+// AcuriteSimulationTiming.h), and every fixed threshold is scaled by how far
+// the clusters next to it have drifted. A capture that's right on the
+// nominal timing gets the fixed thresholds back.
+class AcuriteCalibrator
+{
+public:
+	AcuriteCalibrator( uint32_t sample_rate_hz );
+
+	// A pulse of width samples; high if the line was high during it.
+	void Pulse( uint64_t width, bool high );
+
+	// The thresholds for this capture go into timing. Returns false, leaving
+	// timing alone, if some class had too few pulses or drifted too far.
+	bool Calibrate( AcuRiteTiming& timing ) const;
+
+protected:
+	struct Histogram
+	{
+		uint32_t mCount[ ACURITE_CALIBRATION_BINS ];
+		uint64_t mSum[ ACURITE_CALIBRATION_BINS ]; // widths, in samples
+	};
+
+	// Centers (in samples), starting from the nominal widths. False if a
+	// cluster has too few pulses.
+	bool Cluster( const Histogram& histogram, double* centers, int count ) const;
+
+	uint32_t mSampleRateHz;
+	uint64_t mMaxWidth; // samples in BIT_WIDTH
+	Histogram mHigh;
+	Histogram mLow;
+};
+
+#endif //ACURITE_CALIBRATION_H
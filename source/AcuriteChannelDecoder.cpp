@@ -0,0 +1,307 @@
+#include "AcuriteChannelDecoder.h"
+#include "AcuriteCalibration.h"
+
+// Windows queued for a channel thread before Push() waits for it to catch up
+#define MAX_PENDING_BATCHES 64
+
+AcuriteChannelDecoder::AcuriteChannelDecoder( const AcuriteDecoderOptions& options, unsigned threads )
+:	mOptions( options ),
+	mThreads( threads ),
+	mFilter( options.mGlitchWidthUs == 0 ? 0 : AcuRiteTiming::atLeast( options.mGlitchWidthUs, options.mSampleRateHz ) ),
+	mDecoder( options ),
+	mGap( AcuRiteTiming::atLeast( ACURITE_SEGMENT_GAP_US, options.mSampleRateHz ) ),
+	mBitWidth( options.mTiming.bitWidth ),
+	mLastEdge( 0 ),
+	mSegmentEdges( 0 ),
+	mCalibrating( options.mCalibrationEdges > 0 ),
+	mCalibrated( false ),
+	mCalibrationHigh( false )
+{
+	// The segment decoders need the final thresholds, so they wait for calibration
+	if( threads > 1 && !mCalibrating )
+		mParallel.reset( new AcuriteParallelDecoder( threads, mOptions ) );
+}
+
+void AcuriteChannelDecoder::Edge( uint64_t sample, bool high, AcuriteDecodeSink& sink )
+{
+	uint64_t edge;
+	bool edge_high;
+	if( mFilter.Edge( sample, high, edge, edge_high ) )
+		Accept( edge, edge_high, sink );
+}
+
+void AcuriteChannelDecoder::Edges( const uint64_t* samples, size_t count, bool first_high, AcuriteDecodeSink& sink )
+{
+	if( mFiltered.size() < count + 1 )
+		mFiltered.resize( count + 1 );
+
+	bool high;
+	size_t n = mFilter.Edges( samples, count, first_high, &mFiltered[ 0 ], high );
+	for( size_t i = 0; i < n; i++ )
+	{
+		Accept( mFiltered[ i ], high, sink );
+		high = !high;
+	}
+}
+
+// An edge that made it through the glitch filter
+void AcuriteChannelDecoder::Accept( uint64_t sample, bool high, AcuriteDecodeSink& sink )
+{
+	if( !mCalibrating )
+	{
+		Decode( sample, high, sink );
+		return;
+	}
+
+	if( mCalibrationEdges.empty() )
+		mCalibrationHigh = high;
+	mCalibrationEdges.push_back( sample );
+	if( mCalibrationEdges.size() >= mOptions.mCalibrationEdges )
+		Calibrate( sink );
+}
+
+void AcuriteChannelDecoder::Decode( uint64_t sample, bool high, AcuriteDecodeSink& sink )
+{
+	// Decoding starts over after a quiet gap (or a long noisy stretch), so
+	// the result doesn't depend on how the capture was split up
+	bool split = sample - mLastEdge > mGap ||
+		( mSegmentEdges >= ACURITE_SEGMENT_MAX_EDGES && sample - mLastEdge > mBitWidth );
+
+	if( mParallel.get() )
+	{
+		if( split && mSegment.get() )
+			mParallel->Submit( mSegment.release(), sink );
+		if( !mSegment.get() )
+			mSegment.reset( new AcuriteSegment( mLastEdge, high ) );
+		mSegment->mEdges.push_back( sample );
+	}
+	else
+	{
+		if( split )
+		{
+			mDecoder.Finish( sink );
+			mDecoder.Reset( mLastEdge );
+		}
+		mDecoder.Edge( sample, high, sink );
+	}
+
+	mSegmentEdges = split ? 1 : mSegmentEdges + 1;
+	mLastEdge = sample;
+}
+
+// Fit the thresholds to the collected edges, then decode them
+void AcuriteChannelDecoder::Calibrate( AcuriteDecodeSink& sink )
+{
+	AcuriteCalibrator calibrator( mOptions.mSampleRateHz );
+	bool high = mCalibrationHigh;
+	for( size_t i = 1; i < mCalibrationEdges.size(); i++ )
+	{
+		// The pulse ending here had the level before this edge
+		high = !high;
+		calibrator.Pulse( mCalibrationEdges[ i ] - mCalibrationEdges[ i - 1 ], !high );
+	}
+
+	mCalibrated = calibrator.Calibrate( mOptions.mTiming );
+	mCalibrating = false;
+	mBitWidth = mOptions.mTiming.bitWidth;
+	mDecoder = AcuriteEdgeDecoder( mOptions );
+	if( mThreads > 1 )
+		mParallel.reset( new AcuriteParallelDecoder( mThreads, mOptions ) );
+
+	std::vector< uint64_t > edges;
+	edges.swap( mCalibrationEdges );
+	high = mCalibrationHigh;
+	for( size_t i = 0; i < edges.size(); i++ )
+	{
+		Decode( edges[ i ], high, sink );
+		high = !high;
+	}
+}
+
+void AcuriteChannelDecoder::Quiet( uint64_t sample, AcuriteDecodeSink& sink )
+{
+	uint64_t edge;
+	bool high;
+	if( mFilter.Release( sample, edge, high ) )
+		Accept( edge, high, sink );
+
+	if( mSegment.get() && sample >= GetGapEnd() )
+		mParallel->Submit( mSegment.release(), sink );
+	else if( !mParallel.get() && !mCalibrating )
+		mDecoder.Quiet( sample, sink );
+}
+
+void AcuriteChannelDecoder::Flush( AcuriteDecodeSink& sink )
+{
+	if( mParallel.get() )
+		mParallel->Flush( sink );
+}
+
+void AcuriteChannelDecoder::Finish( AcuriteDecodeSink& sink )
+{
+	uint64_t edge;
+	bool high;
+	if( mFilter.Release( ~(uint64_t)0, edge, high ) )
+		Accept( edge, high, sink );
+
+	if( mCalibrating )
+		Calibrate( sink );
+	Quiet( ~(uint64_t)0, sink );
+	Flush( sink );
+}
+
+void AcuriteChannelDecoder::GetMetrics( AcuriteMetrics& metrics ) const
+{
+	metrics.mEdges += mFilter.GetEdges();
+	metrics.mFiltered += mFilter.GetFiltered();
+	metrics.Merge( mDecoder.GetMetrics() );
+	if( mParallel.get() )
+		metrics.Merge( mParallel->GetMetrics() );
+}
+
+void AcuriteChannelThread::OutputSink::OnMarker( uint64_t sample )
+{
+	Output output;
+	output.mKey = sample;
+	output.mIsPacket = false;
+	mOutputs.push_back( output );
+}
+
+void AcuriteChannelThread::OutputSink::OnPacket( const AcuritePacket& packet )
+{
+	Output output;
+	output.mKey = packet.mStartSample;
+	output.mIsPacket = true;
+	output.mPacket = packet;
+	output.mPacket.mInput = mInput;
+	output.mPacket.mInputMask = 1 << mInput;
+	mOutputs.push_back( output );
+}
+
+AcuriteChannelThread::AcuriteChannelThread( const AcuriteDecoderOptions& options, uint8_t input )
+:	mDecoder( options, 1 ),
+	mSink( input ),
+	mBusy( false ),
+	mStopping( false ),
+	mWatermark( 0 ),
+	mPendingStart( ~(uint64_t)0 ),
+	mWaiting( false )
+{
+	mThread = std::thread( &AcuriteChannelThread::Run, this );
+}
+
+AcuriteChannelThread::~AcuriteChannelThread()
+{
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		mStopping = true;
+	}
+	mInputSignal.notify_all();
+	mThread.join();
+}
+
+void AcuriteChannelThread::Push( std::vector< uint64_t >& edges, bool first_high, uint64_t window_end )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	// Nothing to decode: no need to wake the thread just to move the watermark
+	if( edges.empty() && mInput.empty() && !mBusy && !mWaiting )
+	{
+		mWatermark = window_end + 1 < mPendingStart ? window_end + 1 : mPendingStart;
+		return;
+	}
+
+	while( mInput.size() >= MAX_PENDING_BATCHES )
+		mIdleSignal.wait( lock );
+
+	mInput.push_back( Batch() );
+	mInput.back().mEdges.swap( edges );
+	mInput.back().mFirstHigh = first_high;
+	mInput.back().mWindowEnd = window_end;
+	lock.unlock();
+
+	mInputSignal.notify_one();
+}
+
+void AcuriteChannelThread::Sync()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+	while( !mInput.empty() || mBusy )
+		mIdleSignal.wait( lock );
+}
+
+bool AcuriteChannelThread::Peek( uint64_t& key )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	if( mOutput.empty() )
+	{
+		key = mWatermark;
+		return false;
+	}
+	key = mOutput.front().mKey;
+	return true;
+}
+
+void AcuriteChannelThread::Pop( AcuriteDecodeSink& sink )
+{
+	Output output;
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		output = mOutput.front();
+		mOutput.pop_front();
+	}
+
+	if( output.mIsPacket )
+		sink.OnPacket( output.mPacket );
+	else
+		sink.OnMarker( output.mKey );
+}
+
+void AcuriteChannelThread::GetMetrics( AcuriteMetrics& metrics )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	metrics.Merge( mMetrics );
+}
+
+void AcuriteChannelThread::Run()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+	for( ;; )
+	{
+		while( mInput.empty() && !mStopping )
+			mInputSignal.wait( lock );
+		if( mInput.empty() )
+			return;
+
+		Batch batch;
+		batch.mEdges.swap( mInput.front().mEdges );
+		batch.mFirstHigh = mInput.front().mFirstHigh;
+		batch.mWindowEnd = mInput.front().mWindowEnd;
+		mInput.pop_front();
+		mBusy = true;
+		lock.unlock();
+
+		if( !batch.mEdges.empty() )
+			mDecoder.Edges( &batch.mEdges[ 0 ], batch.mEdges.size(), batch.mFirstHigh, mSink );
+		mDecoder.Quiet( batch.mWindowEnd, mSink );
+
+		// Anything still to come is either the packet being assembled or
+		// starts after this window
+		uint64_t pending = mDecoder.GetPendingStart();
+		uint64_t watermark = batch.mWindowEnd + 1 < pending ? batch.mWindowEnd + 1 : pending;
+
+		bool waiting = mDecoder.IsWaiting();
+		mSnapshot.Clear();
+		mDecoder.GetMetrics( mSnapshot );
+
+		lock.lock();
+		mMetrics = mSnapshot;
+		mPendingStart = pending;
+		mWaiting = waiting;
+		mOutput.insert( mOutput.end(), mSink.mOutputs.begin(), mSink.mOutputs.end() );
+		mSink.mOutputs.clear();
+		mWatermark = watermark;
+		mBusy = false;
+		mIdleSignal.notify_all();
+	}
+}
@@ -0,0 +1,178 @@
+#ifndef ACURITE_CHANNEL_DECODER_H
+#define ACURITE_CHANNEL_DECODER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AcuriteEdgeDecoder.h"
+#include "AcuriteGlitchFilter.h"
+#include "AcuriteParallelDecoder.h"
+
+// Everything that happens to one input channel's edges: decoding restarts
+// at quiet gaps (and long noisy stretches), so the output is the same whether
+// the edges are decoded here as they arrive (threads == 1) or cut into
+// segments for an AcuriteParallelDecoder.
+//
+// With options.mGlitchWidthUs, edges go through an AcuriteGlitchFilter first.
+// With options.mCalibrationEdges, the first edges are only collected until
+// there are enough to calibrate the thresholds; then they're decoded with
+// the fitted ones, along with everything after.
+class AcuriteChannelDecoder
+{
+public:
+	AcuriteChannelDecoder( const AcuriteDecoderOptions& options, unsigned threads );
+
+	// One edge from the capture; high is the line level after it.
+	void Edge( uint64_t sample, bool high, AcuriteDecodeSink& sink );
+	// A run of edges with alternating levels, the first one leaving the line at first_high.
+	void Edges( const uint64_t* samples, size_t count, bool first_high, AcuriteDecodeSink& sink );
+
+	// There is no edge up to and including sample. Lets an open segment (or a
+	// packet held for repeats) go once that makes a long enough gap.
+	void Quiet( uint64_t sample, AcuriteDecodeSink& sink );
+
+	// Wait for any segments still being decoded.
+	void Flush( AcuriteDecodeSink& sink );
+
+	// The capture is over: calibrate on what there is if it's too short to
+	// have finished, and pass on everything still pending.
+	void Finish( AcuriteDecodeSink& sink );
+
+	// An edge held by the glitch filter, an open segment or a held packet is
+	// waiting for Quiet()
+	bool IsWaiting() const { return mFilter.IsHolding() || mSegment.get() != NULL || mDecoder.IsHolding(); }
+	// No edge up to here means the edge held by the glitch filter is clear,
+	// or if there's none, that the current segment is over
+	uint64_t GetGapEnd() const
+	{
+		if( mFilter.IsHolding() )
+			return mFilter.GetHeld() + mFilter.GetMinWidth() - 1;
+		return mLastEdge + mGap;
+	}
+	// Nothing reported from now on starts before this (decoding on this thread only)
+	uint64_t GetPendingStart() const
+	{
+		uint64_t start = mCalibrating && !mCalibrationEdges.empty() ? mCalibrationEdges[ 0 ] : mDecoder.GetPendingStart();
+		if( mFilter.IsHolding() && mFilter.GetHeld() < start )
+			start = mFilter.GetHeld();
+		return start;
+	}
+
+	// Still collecting edges to calibrate on
+	bool IsCalibrating() const { return mCalibrating; }
+	// The thresholds in use (the fixed ones until calibration is done)
+	const AcuRiteTiming& GetTiming() const { return mOptions.mTiming; }
+	// Calibration fitted the thresholds (false if it kept the fixed ones)
+	bool IsCalibrated() const { return mCalibrated; }
+
+	// How many edges the glitch filter has seen and dropped
+	const AcuriteGlitchFilter& GetGlitchFilter() const { return mFilter; }
+
+	// Adds this channel's counts so far to metrics
+	void GetMetrics( AcuriteMetrics& metrics ) const;
+
+protected:
+	void Accept( uint64_t sample, bool high, AcuriteDecodeSink& sink );
+	void Decode( uint64_t sample, bool high, AcuriteDecodeSink& sink );
+	void Calibrate( AcuriteDecodeSink& sink );
+
+	AcuriteDecoderOptions mOptions;
+	unsigned mThreads;
+	AcuriteGlitchFilter mFilter;
+	std::vector< uint64_t > mFiltered; // Edges() output from mFilter
+	AcuriteEdgeDecoder mDecoder;
+	std::unique_ptr< AcuriteParallelDecoder > mParallel;
+	std::unique_ptr< AcuriteSegment > mSegment;
+	uint64_t mGap;
+	uint64_t mBitWidth;
+	uint64_t mLastEdge;
+	uint64_t mSegmentEdges;
+
+	bool mCalibrating;
+	bool mCalibrated;
+	bool mCalibrationHigh; // line level after mCalibrationEdges[ 0 ]
+	std::vector< uint64_t > mCalibrationEdges;
+};
+
+// One input of a multi-channel capture, decoded on its own thread. The
+// analyzer thread pushes edges in windows and pulls the output back, in
+// order, through Peek()/Pop() so it can merge all inputs by time.
+class AcuriteChannelThread
+{
+public:
+	AcuriteChannelThread( const AcuriteDecoderOptions& options, uint8_t input );
+	~AcuriteChannelThread();
+
+	// All of this input's edges up to and including window_end (taken over
+	// by swapping), the first one leaving the line at first_high.
+	void Push( std::vector< uint64_t >& edges, bool first_high, uint64_t window_end );
+
+	// Wait until everything pushed so far has been decoded.
+	void Sync();
+
+	// If there's output waiting, its merge key (a marker's sample or a
+	// packet's start) goes in key and Peek() returns true. Otherwise key is
+	// a lower bound for the key of anything still to come.
+	bool Peek( uint64_t& key );
+	// Hand the first waiting output to sink.
+	void Pop( AcuriteDecodeSink& sink );
+
+	// Adds the counts as of the last batch decoded to metrics
+	void GetMetrics( AcuriteMetrics& metrics );
+
+protected:
+	struct Batch
+	{
+		std::vector< uint64_t > mEdges;
+		bool mFirstHigh;
+		uint64_t mWindowEnd;
+	};
+
+	struct Output
+	{
+		uint64_t mKey;
+		bool mIsPacket;
+		AcuritePacket mPacket;
+	};
+
+	class OutputSink : public AcuriteDecodeSink
+	{
+	public:
+		OutputSink( uint8_t input ) : mInput( input ) {}
+		virtual void OnMarker( uint64_t sample );
+		virtual void OnPacket( const AcuritePacket& packet );
+
+		uint8_t mInput;
+		std::vector< Output > mOutputs;
+	};
+
+	void Run();
+
+	AcuriteChannelDecoder mDecoder;
+	OutputSink mSink; // decoder thread only
+	AcuriteMetrics mSnapshot; // ditto
+
+	std::mutex mMutex;
+	std::condition_variable mInputSignal;
+	std::condition_variable mIdleSignal;
+	std::deque< Batch > mInput;
+	bool mBusy;
+	bool mStopping;
+	std::deque< Output > mOutput;
+	uint64_t mWatermark;
+	uint64_t mPendingStart; // the decoder's, as of the last batch
+	bool mWaiting;          // ditto IsWaiting()
+	AcuriteMetrics mMetrics; // ditto GetMetrics()
+
+	std::thread mThread;
+
+private:
+	AcuriteChannelThread( const AcuriteChannelThread& );
+	AcuriteChannelThread& operator=( const AcuriteChannelThread& );
+};
+
+#endif //ACURITE_CHANNEL_DECODER_H
@@ -0,0 +1,48 @@
+#include "AcuriteCommitScheduler.h"
+#include <Analyzer.h>
+#include "AcuriteAnalyzerResults.h"
+
+AcuriteCommitScheduler::AcuriteCommitScheduler( Analyzer* analyzer, AcuriteAnalyzerResults* results, U32 latency_ms )
+:	mAnalyzer( analyzer ),
+	mResults( results ),
+	mLatency( std::chrono::milliseconds( latency_ms ) ),
+	mLastCommit( std::chrono::steady_clock::now() ),
+	mPending( 0 ),
+	mProgress( 0 ),
+	mEdges( 0 ),
+	mCommits( 0 )
+{
+}
+
+void AcuriteCommitScheduler::Added( U64 sample )
+{
+	if( sample > mProgress )
+		mProgress = sample;
+	if( mPending++ == 0 )
+		mLastCommit = std::chrono::steady_clock::now();
+
+	if( mPending >= ACURITE_COMMIT_FRAMES || mLatency.count() == 0 )
+		Commit();
+	else
+		Check();
+}
+
+void AcuriteCommitScheduler::Commit()
+{
+	bool burst = mResults->EndBurst( mProgress );
+	if( mPending > 0 || burst )
+		mResults->Commit();
+	mAnalyzer->ReportProgress( mProgress );
+	mPending = 0;
+	mEdges = 0;
+	mCommits++;
+	mLastCommit = std::chrono::steady_clock::now();
+}
+
+// Commit if it's been long enough
+void AcuriteCommitScheduler::Check()
+{
+	mEdges = 0;
+	if( std::chrono::steady_clock::now() - mLastCommit >= mLatency )
+		Commit();
+}
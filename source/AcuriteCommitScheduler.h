@@ -0,0 +1,64 @@
+#ifndef ACURITE_COMMIT_SCHEDULER_H
+#define ACURITE_COMMIT_SCHEDULER_H
+
+#include <AnalyzerTypes.h>
+#include <chrono>
+
+class Analyzer;
+class AcuriteAnalyzerResults;
+
+// Frames committed together at most
+#define ACURITE_COMMIT_FRAMES 1024
+// Edges read between looks at the clock
+#define ACURITE_PROGRESS_EDGES 4096
+// Longest latency that may be set
+#define ACURITE_MAX_LATENCY_MS 10000
+
+// Decides when the results get committed and progress gets reported.
+// Frames are committed in batches, once ACURITE_COMMIT_FRAMES have piled
+// up or the oldest has waited latency_ms, whichever comes first. The edge
+// loop reports how far it's got, so progress moves along through stretches
+// with no frames too, and commits whatever's pending once it catches up
+// with a live capture. A burst of frames is committed as a packet once the
+// edge loop is far enough past it that no more copies can come.
+class AcuriteCommitScheduler
+{
+public:
+	// latency_ms 0 commits every frame as it comes
+	AcuriteCommitScheduler( Analyzer* analyzer, AcuriteAnalyzerResults* results, U32 latency_ms );
+
+	// A frame ending at sample went into the results
+	void Added( U64 sample );
+
+	// The edge loop has read edges more, up to sample
+	void Progress( U64 sample, U64 edges = 1 )
+	{
+		if( sample > mProgress )
+			mProgress = sample;
+		mEdges += edges;
+		if( mEdges >= ACURITE_PROGRESS_EDGES )
+			Check();
+	}
+
+	// Frames added but not committed yet
+	bool IsPending() const { return mPending > 0; }
+
+	// Commit and report progress now
+	void Commit();
+	// Times that happened so far
+	U64 GetCommits() const { return mCommits; }
+
+protected:
+	void Check();
+
+	Analyzer* mAnalyzer;
+	AcuriteAnalyzerResults* mResults;
+	std::chrono::steady_clock::duration mLatency;
+	std::chrono::steady_clock::time_point mLastCommit;
+	U64 mPending;
+	U64 mProgress;
+	U64 mEdges; // since the clock was last looked at
+	U64 mCommits;
+};
+
+#endif //ACURITE_COMMIT_SCHEDULER_H
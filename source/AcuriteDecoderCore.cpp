@@ -0,0 +1,155 @@
+#include "AcuriteDecoderCore.h"
+#include "AcuriteChannelDecoder.h"
+#include <new>
+#include <string.h>
+
+static_assert( ACURITE_DECODE_BAD_SIZE == ACURITE_PACKET_BAD_SIZE &&
+	ACURITE_DECODE_BAD_PARITY == ACURITE_PACKET_BAD_PARITY &&
+	ACURITE_DECODE_BAD_CHECKSUM == ACURITE_PACKET_BAD_CHECKSUM &&
+	ACURITE_DECODE_CORRECTED == ACURITE_PACKET_CORRECTED, "flag values must match AcuritePacket's" );
+
+// Turns AcuritePackets into acurite_packets for a callback; markers aren't
+// part of the C interface.
+class AcuriteCallbackSink : public AcuriteDecodeSink
+{
+public:
+	AcuriteCallbackSink( acurite_packet_fn fn, void* context )
+	:	mFn( fn ), mContext( context ), mCount( 0 ) {}
+
+	virtual void OnMarker( uint64_t sample ) {}
+
+	virtual void OnPacket( const AcuritePacket& packet )
+	{
+		acurite_packet out;
+		out.start_sample = packet.mStartSample;
+		out.end_sample = packet.mEndSample;
+		memcpy( out.data, packet.mData, sizeof out.data );
+		out.size = packet.mSize;
+		out.flags = packet.mFlags;
+		out.parity_byte = packet.mParityByte;
+		out.repeats = packet.mRepeats;
+		out.corrected_bit = packet.mCorrectedBit;
+
+		bool valid = ( packet.mFlags & ACURITE_PACKET_ERRORS ) == 0;
+		out.channel = valid ? packet.mChannel : 'x';
+		out.sensor_id = valid ? packet.mSensorId : 0;
+		out.humidity = valid ? packet.mHumidity : 0;
+		out.temperature_c10 = valid ? AcuriteCelsiusTenths( packet ) : 0;
+
+		mCount++;
+		if( mFn != NULL )
+			mFn( &out, mContext );
+	}
+
+	acurite_packet_fn mFn;
+	void* mContext;
+	size_t mCount;
+};
+
+struct acurite_decoder
+{
+	acurite_decoder( const AcuriteDecoderOptions& options, unsigned threads )
+	:	mOptions( options ), mThreads( threads ), mDecoder( options, threads ), mStarted( false ) {}
+
+	AcuriteDecoderOptions mOptions;
+	unsigned mThreads;
+	AcuriteChannelDecoder mDecoder;
+	bool mStarted; // seen the first edge
+};
+
+acurite_decoder* acurite_decoder_new( uint32_t sample_rate_hz, uint32_t repeat_window_us, unsigned threads )
+{
+	if( sample_rate_hz == 0 || repeat_window_us > ACURITE_MAX_REPEAT_WINDOW_US || threads == 0 )
+		return NULL;
+
+	AcuriteDecoderOptions options( sample_rate_hz );
+	options.mRepeatWindowUs = repeat_window_us;
+	return new( std::nothrow ) acurite_decoder( options, threads );
+}
+
+void acurite_decoder_free( acurite_decoder* decoder )
+{
+	delete decoder;
+}
+
+int acurite_decoder_calibrate( acurite_decoder* decoder, uint32_t edges )
+{
+	if( decoder->mStarted )
+		return -1;
+
+	decoder->mOptions.mCalibrationEdges = edges;
+	decoder->mDecoder = AcuriteChannelDecoder( decoder->mOptions, decoder->mThreads );
+	return 0;
+}
+
+int acurite_decoder_correct( acurite_decoder* decoder, int enable )
+{
+	if( decoder->mStarted )
+		return -1;
+
+	decoder->mOptions.mCorrectBits = enable != 0;
+	decoder->mDecoder = AcuriteChannelDecoder( decoder->mOptions, decoder->mThreads );
+	return 0;
+}
+
+int acurite_decoder_deglitch( acurite_decoder* decoder, uint32_t min_width_us )
+{
+	if( decoder->mStarted || min_width_us > ACURITE_GLITCH_MAX_US )
+		return -1;
+
+	decoder->mOptions.mGlitchWidthUs = min_width_us;
+	decoder->mDecoder = AcuriteChannelDecoder( decoder->mOptions, decoder->mThreads );
+	return 0;
+}
+
+// The next edges of the capture, into sink
+static void Feed( acurite_decoder* decoder, const uint64_t* edge_times, size_t n, int first_high, AcuriteDecodeSink& sink )
+{
+	bool high = first_high != 0;
+	size_t i = 0;
+
+	// Have to start on a low pulse, as the analyzer does
+	if( !decoder->mStarted && n > 0 )
+	{
+		decoder->mStarted = true;
+		if( !high )
+		{
+			i++;
+			high = true;
+		}
+	}
+
+	if( i < n )
+		decoder->mDecoder.Edges( edge_times + i, n - i, high, sink );
+}
+
+static void Finish( acurite_decoder* decoder, AcuriteDecodeSink& sink )
+{
+	decoder->mDecoder.Finish( sink );
+}
+
+void acurite_decoder_edges( acurite_decoder* decoder, const uint64_t* edge_times, size_t n, int first_high,
+	acurite_packet_fn fn, void* context )
+{
+	AcuriteCallbackSink sink( fn, context );
+	Feed( decoder, edge_times, n, first_high, sink );
+}
+
+void acurite_decoder_finish( acurite_decoder* decoder, acurite_packet_fn fn, void* context )
+{
+	AcuriteCallbackSink sink( fn, context );
+	Finish( decoder, sink );
+}
+
+size_t acurite_decode_pulses( const uint64_t* edge_times, size_t n, int first_high, uint32_t sample_rate_hz,
+	acurite_packet_fn fn, void* context )
+{
+	if( sample_rate_hz == 0 )
+		return 0;
+
+	acurite_decoder decoder( AcuriteDecoderOptions( sample_rate_hz ), 1 );
+	AcuriteCallbackSink sink( fn, context );
+	Feed( &decoder, edge_times, n, first_high, sink );
+	Finish( &decoder, sink );
+	return sink.mCount;
+}
@@ -0,0 +1,99 @@
+#ifndef ACURITE_DECODER_CORE_H
+#define ACURITE_DECODER_CORE_H
+
+/*
+ * Plain C interface to the AcuRite decoder, built into libAcuriteDecoder.a
+ * with no Saleae headers. It runs the same code as the analyzer plugin, so
+ * the same edges give the same packets.
+ *
+ * Edges are sample numbers counted from the start of the capture, in
+ * increasing order, alternating in level. first_high is the line level
+ * after the first edge in a call. Pass the edges in batches as large as is
+ * convenient.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* acurite_packet.flags; the sensor fields are only valid when none of the
+ * BAD ones is set */
+#define ACURITE_DECODE_BAD_SIZE     0x01
+#define ACURITE_DECODE_BAD_PARITY   0x02
+#define ACURITE_DECODE_BAD_CHECKSUM 0x04
+#define ACURITE_DECODE_CORRECTED    0x08 /* valid once corrected_bit was flipped (see acurite_decoder_correct) */
+
+typedef struct acurite_packet {
+	uint64_t start_sample;
+	uint64_t end_sample;
+	uint8_t data[7];           /* as received */
+	uint8_t size;              /* bytes the decoder returned */
+	uint8_t flags;
+	uint8_t parity_byte;       /* with ACURITE_DECODE_BAD_PARITY */
+	uint8_t repeats;           /* further copies folded in (see repeat_window_us) */
+	uint8_t corrected_bit;     /* with ACURITE_DECODE_CORRECTED: 0 is the first bit received */
+	char channel;              /* 'A', 'B', 'C' or 'x' */
+	uint16_t sensor_id;
+	uint8_t humidity;          /* percent */
+	int16_t temperature_c10;   /* tenths of a degree C */
+} acurite_packet;
+
+/* Called once per packet, valid or not, in capture order */
+typedef void (*acurite_packet_fn)(const acurite_packet *packet, void *context);
+
+typedef struct acurite_decoder acurite_decoder;
+
+/*
+ * repeat_window_us: fold copies of a packet that start within this long of
+ * the previous copy (at most 99000; 0 reports every copy).
+ * threads: 1 decodes in the calling thread; more decode quiet-gap delimited
+ * stretches in parallel, with the same results.
+ * Returns NULL if the arguments are out of range or memory runs out.
+ */
+acurite_decoder *acurite_decoder_new(uint32_t sample_rate_hz, uint32_t repeat_window_us, unsigned threads);
+void acurite_decoder_free(acurite_decoder *decoder);
+
+/*
+ * Fit the pulse-width thresholds to the first edges of the capture, then
+ * decode those edges and the rest with them; 0 turns it off again. Until
+ * that many edges have come in (or acurite_decoder_finish), no packets are
+ * reported. Returns -1 if edges have been passed in already.
+ */
+int acurite_decoder_calibrate(acurite_decoder *decoder, uint32_t edges);
+
+/*
+ * Repair packets that fail their parity or checksum test by a single bit
+ * (0 turns it off again). Which bit is chosen from how clearly each one was
+ * received; repaired packets carry ACURITE_DECODE_CORRECTED. Returns -1 if
+ * edges have been passed in already.
+ */
+int acurite_decoder_correct(acurite_decoder *decoder, int enable);
+
+/*
+ * Drop pulses shorter than min_width_us (at most 90) before decoding, along
+ * with the edges either side of them; noise on a cheap receiver is mostly
+ * such spikes. 0 keeps every pulse. Returns -1 if edges have been passed in
+ * already, or min_width_us is out of range.
+ */
+int acurite_decoder_deglitch(acurite_decoder *decoder, uint32_t min_width_us);
+
+/* The next n edges of the capture. Packets may be reported from a later call. */
+void acurite_decoder_edges(acurite_decoder *decoder, const uint64_t *edge_times, size_t n, int first_high,
+                           acurite_packet_fn fn, void *context);
+
+/* End of the capture: report everything still pending. */
+void acurite_decoder_finish(acurite_decoder *decoder, acurite_packet_fn fn, void *context);
+
+/* One-shot: decode a whole capture's edges with default settings. Returns
+ * the number of packets reported. */
+size_t acurite_decode_pulses(const uint64_t *edge_times, size_t n, int first_high, uint32_t sample_rate_hz,
+                             acurite_packet_fn fn, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ACURITE_DECODER_CORE_H
@@ -0,0 +1,441 @@
+#include "AcuriteEdgeDecoder.h"
+#include "AcuriteTrace.h"
+#include <string.h>
+
+AcuriteEdgeDecoder::AcuriteEdgeDecoder( const AcuriteDecoderOptions& options )
+:	mWidthBins( options.mSampleRateHz )
+{
+	// The decoder's thresholds, already in sample counts for this capture
+	mDecoder.timing = options.mTiming;
+	uint32_t window_us = options.mRepeatWindowUs < ACURITE_MAX_REPEAT_WINDOW_US ? options.mRepeatWindowUs : ACURITE_MAX_REPEAT_WINDOW_US;
+	mRepeatWindow = window_us == 0 ? 0 : AcuRiteTiming::atMost( window_us, options.mSampleRateHz );
+	mSegmentGap = AcuRiteTiming::atLeast( ACURITE_SEGMENT_GAP_US, options.mSampleRateHz );
+	mCorrectBits = options.mCorrectBits;
+	mSampleRateHz = options.mSampleRateHz;
+	mBurstGap = AcuRiteTiming::atMost( ACURITE_BURST_GAP_US, mSampleRateHz );
+	Reset( 0 );
+}
+
+void AcuriteEdgeDecoder::Reset( uint64_t previous_edge )
+{
+	mDecoder.resetDecoder();
+	mDecoder.resetRepeats();
+	mDecoder.minSyncs = NUM_SYNCS;
+	mLastEdge = previous_edge;
+	mFrameStart = 0;
+	mInFrame = false;
+	mSkipEdge = false;
+	mHistoryCount = 0;
+	mHolding = false;
+	mHeldMarkers.clear();
+	mInData = false;
+	mInBurst = false;
+}
+
+void AcuriteEdgeDecoder::Edge( uint64_t sample, bool high, AcuriteDecodeSink& sink )
+{
+	// make sure we're at a low level when we're done decoding
+	if( mSkipEdge )
+	{
+		mSkipEdge = false;
+		return;
+	}
+
+	if( !mInFrame || mDecoder.state == AcuRiteDecoder::UNKNOWN )
+	{
+		mInFrame = true;
+		mFrameStart = sample;
+		mHistoryCount = 0;
+		Marker( sample, sink );
+
+		// Too late for this to be another copy of the held packet
+		if( mHolding && mFrameStart - mHeld.mEndSample > mRepeatWindow )
+			Release( sink );
+	}
+
+	// Pass the pulse to the decoder
+	word width = sample - mLastEdge;
+	mLastEdge = sample;
+
+	if( mHistoryCount == ACURITE_RESYNC_HISTORY )
+	{
+		// Longer than any packet: only the recent half can still matter
+		memmove( mHistory, mHistory + ACURITE_RESYNC_HISTORY / 2, sizeof mHistory / 2 );
+		mHistoryCount = ACURITE_RESYNC_HISTORY / 2;
+	}
+	Pulse& pulse = mHistory[ mHistoryCount++ ];
+	pulse.mSample = sample;
+	pulse.mWidth = width;
+	pulse.mHigh = high;
+
+	byte state = mDecoder.state;
+	bool started = ( mDecoder.pos | mDecoder.bits ) != 0;
+	bool done = mDecoder.nextPulse( width );
+	TRACE( TRACE_EDGE, TRACE_PULSE, sample, width, mDecoder.state );
+
+	// Counting stays off the decoder's own branches: these two tests only
+	// come out differently once per frame
+	mMetrics.mWidths[ mWidthBins.Bin( width ) ]++;
+	if( !started && ( mDecoder.pos | mDecoder.bits ) != 0 )
+	{
+		// The first data bit is in, so the sync bits were good
+		mMetrics.mSyncRuns++;
+		mInData = true;
+		mDataStart = std::chrono::steady_clock::now();
+	}
+
+	if( done )
+	{
+		TRACE( TRACE_PACKET, TRACE_PACKET_DONE, sample, 0, mDecoder.state );
+
+		if( mInData )
+		{
+			std::chrono::steady_clock::duration time = std::chrono::steady_clock::now() - mDataStart;
+			mMetrics.mDecodeTimes[ AcuriteMetricsTimeBin( std::chrono::duration_cast< std::chrono::nanoseconds >( time ).count() ) ]++;
+			mInData = false;
+		}
+
+		byte size;
+		const byte* data = mDecoder.getData( size );
+		AcuritePacket packet;
+		AcuriteDecodePacket( data, size, packet );
+
+		packet.mStartSample = mFrameStart;
+		packet.mEndSample = sample;
+
+		if( ( packet.mFlags & ACURITE_PACKET_ERRORS ) && mCorrectBits && Correct( packet ) )
+		{
+			TRACE( TRACE_PACKET, TRACE_CORRECTED, sample, packet.mCorrectedBit, mDecoder.state );
+			// so repeats are recognised by the corrected bytes
+			memcpy( mDecoder.data, packet.mData, sizeof packet.mData );
+		}
+
+		if( ( packet.mFlags & ACURITE_PACKET_ERRORS ) && Resync( sink ) )
+			return;
+
+		Packet( packet, sink );
+		EndFrame( high );
+	}
+	else if( mDecoder.state == AcuRiteDecoder::UNKNOWN )
+	{
+		if( state == AcuRiteDecoder::T3 )
+			mMetrics.mT3Aborts++;
+		else if( state != AcuRiteDecoder::UNKNOWN )
+			mMetrics.mWidthResets++;
+		mInData = false;
+
+		// The frame failed; the next edge starts another unless it can be saved
+		if( !Resync( sink ) )
+			mDecoder.minSyncs = NUM_SYNCS;
+	}
+}
+
+// Tries to fix a bad packet from the decoder by flipping one bit, the
+// ones read least clearly first
+bool AcuriteEdgeDecoder::Correct( AcuritePacket& packet ) const
+{
+	return AcuriteCorrectPacket( packet, mDecoder.margins );
+}
+
+// Fills in the packet's signal quality from the figures the decoder kept
+// as it read the data bits, and its place in the burst
+void AcuriteEdgeDecoder::Measure( AcuritePacket& packet )
+{
+	uint64_t us[ 3 ] = { mDecoder.deviationSum / 112, mDecoder.maxDeviation, mDecoder.minMargin };
+	for( int i = 0; i < 3; i++ )
+	{
+		us[ i ] = us[ i ] * 1000000 / mSampleRateHz;
+		if( us[ i ] > 0xFFFF )
+			us[ i ] = 0xFFFF;
+	}
+	packet.mMeanDeviation = (uint16_t)us[ 0 ];
+	packet.mMaxDeviation = (uint16_t)us[ 1 ];
+	packet.mMinMargin = (uint16_t)us[ 2 ];
+	packet.mSyncs = mDecoder.flip;
+
+	if( mInBurst && packet.mStartSample - mBurstEnd <= mBurstGap && mBurstCopies < 255 )
+		mBurstCopies++;
+	else
+		mBurstCopies = 0;
+	packet.mCopy = mBurstCopies;
+	mInBurst = true;
+	mBurstEnd = packet.mEndSample;
+}
+
+void AcuriteEdgeDecoder::Count( const AcuritePacket& packet )
+{
+	if( packet.mFlags & ACURITE_PACKET_BAD_SIZE )
+		mMetrics.mBadSizes++;
+	if( packet.mFlags & ACURITE_PACKET_BAD_PARITY )
+	{
+		uint64_t parity = AcuriteParityErrors( AcuriteLoadPacket( packet.mData ) );
+		for( int i = 1; i <= 5; i++ )
+			mMetrics.mParityFailures[ i ] += parity >> ( 8 * i ) & 1;
+	}
+	if( packet.mFlags & ACURITE_PACKET_BAD_CHECKSUM )
+		mMetrics.mChecksumFailures++;
+	if( !( packet.mFlags & ACURITE_PACKET_ERRORS ) )
+		mMetrics.mPackets++;
+	if( packet.mFlags & ACURITE_PACKET_CORRECTED )
+		mMetrics.mCorrected++;
+}
+
+void AcuriteEdgeDecoder::Packet( AcuritePacket& packet, AcuriteDecodeSink& sink )
+{
+	Measure( packet );
+	Count( packet );
+	if( mRepeatWindow == 0 )
+	{
+		sink.OnPacket( packet );
+	}
+	else if( packet.mFlags & ACURITE_PACKET_ERRORS )
+	{
+		// A bad copy ends the run
+		Release( sink );
+		mDecoder.resetRepeats();
+		sink.OnPacket( packet );
+	}
+	else if( mDecoder.checkRepeats( packet.mStartSample, packet.mEndSample, mRepeatWindow ) && mHolding )
+	{
+		// Another copy: stretch the held frame over it. Its markers are
+		// inside the frame now.
+		mHeld.mEndSample = packet.mEndSample;
+		mHeld.mRepeats++;
+		mHeldMarkers.clear();
+	}
+	else
+	{
+		Release( sink );
+		mHeld = packet;
+		mHolding = true;
+	}
+}
+
+// A packet is done; high is the level its last edge left the line at
+void AcuriteEdgeDecoder::EndFrame( bool high )
+{
+	mDecoder.resetDecoder();
+	mDecoder.minSyncs = NUM_SYNCS;
+	mInFrame = false;
+	mSkipEdge = high;
+}
+
+// Runs the frame's pulses from first on through decoder, which starts from
+// scratch. With merge_glitches, a pulse too short for any class is taken to
+// be a glitch and joined with the pulses either side of it. Returns the
+// index of the pulse that completed a packet, mHistoryCount if the decoder
+// is still going at the end, or -1 if it failed.
+int AcuriteEdgeDecoder::Replay( AcuRiteDecoder& decoder, size_t first, bool merge_glitches ) const
+{
+	for( size_t i = first; i < mHistoryCount; i++ )
+	{
+		word width = mHistory[ i ].mWidth;
+		while( merge_glitches && i > first && i + 2 < mHistoryCount &&
+			   decoder.classify( mHistory[ i + 1 ].mWidth ) == ACURITE_W_SHORT )
+		{
+			width += mHistory[ i + 1 ].mWidth + mHistory[ i + 2 ].mWidth;
+			i += 2;
+		}
+
+		if( decoder.nextPulse( width ) )
+			return (int)i;
+		if( decoder.state == AcuRiteDecoder::UNKNOWN )
+			return -1;
+	}
+	return (int)mHistoryCount;
+}
+
+// The frame failed, or made a packet that doesn't validate. Its pulses are
+// tried again on three guesses about what went wrong:
+//   - the receiver lost the first sync bit: accept NUM_SYNCS - 1 of them
+//   - a glitch split a pulse: join any too-short pulse to its neighbours
+//   - the frame started on noise, or ran into the next copy: start over at
+//     a later sync bit
+// The first guess that gives a packet that validates wins; failing that, one
+// that's still decoding happily at the latest pulse carries on from there
+// (a later sync first). Returns false if no guess helped.
+bool AcuriteEdgeDecoder::Resync( AcuriteDecodeSink& sink )
+{
+	if( mHistoryCount < 3 )
+		return false;
+
+	bool glitches = false;
+	for( size_t i = 1; i < mHistoryCount && !glitches; i++ )
+		glitches = mDecoder.classify( mHistory[ i ].mWidth ) == ACURITE_W_SHORT;
+
+	AcuRiteDecoder trial;
+	AcuRiteDecoder going; // a guess still decoding at the end
+	size_t going_start = 0;
+	int going_rank = 0;   // 0: none; higher is better
+	size_t start = 0;
+	int end = -1;
+
+	for( int guess = 0; guess < 2 && end < 0; guess++ )
+	{
+		if( guess == 1 && !glitches )
+			continue;
+
+		trial = mDecoder;
+		trial.resetDecoder();
+		trial.minSyncs = guess == 0 ? NUM_SYNCS - 1 : NUM_SYNCS;
+		end = Replay( trial, 0, guess == 1 );
+
+		if( end == (int)mHistoryCount )
+		{
+			// Only interesting once it's past where a strict decoder stops
+			bool data = trial.pos > 0 || trial.bits > 0 || trial.state == AcuRiteDecoder::T1 || trial.state == AcuRiteDecoder::T2;
+			if( ( guess == 1 || data ) && going_rank < 2 - guess )
+			{
+				going = trial;
+				going_start = 0;
+				going_rank = 2 - guess;
+			}
+			end = -1;
+		}
+		else if( end >= 0 )
+		{
+			byte size;
+			AcuritePacket packet;
+			AcuriteDecodePacket( trial.getData( size ), trial.pos, packet );
+			if( packet.mFlags & ACURITE_PACKET_ERRORS )
+				end = -1;
+		}
+	}
+
+	// A later sync bit, with the pulse before it as the start of the frame
+	for( size_t k = 2; k < mHistoryCount && end < 0 && going_rank < 3; k++ )
+	{
+		if( mHistory[ k ].mHigh || mDecoder.classify( mHistory[ k ].mWidth ) != ACURITE_W_SYNC )
+			continue;
+
+		trial = mDecoder;
+		trial.resetDecoder();
+		trial.minSyncs = NUM_SYNCS;
+		int result = Replay( trial, k - 1, false );
+
+		if( result == (int)mHistoryCount )
+		{
+			if( trial.flip > 0 )
+			{
+				going = trial;
+				going_start = k - 1;
+				going_rank = 3;
+			}
+		}
+		else if( result >= 0 )
+		{
+			byte size;
+			AcuritePacket packet;
+			AcuriteDecodePacket( trial.getData( size ), trial.pos, packet );
+			if( !( packet.mFlags & ACURITE_PACKET_ERRORS ) )
+			{
+				start = k - 1;
+				end = result;
+			}
+		}
+	}
+
+	if( end >= 0 )
+	{
+		TRACE( TRACE_PACKET, TRACE_RESYNC, mHistory[ start ].mSample, end - start, 1 );
+
+		// A packet: report it, then go on with whatever pulses followed it
+		byte size;
+		AcuritePacket packet;
+		AcuriteDecodePacket( trial.getData( size ), trial.pos, packet );
+		packet.mStartSample = mHistory[ start ].mSample;
+		packet.mEndSample = mHistory[ end ].mSample;
+		if( start > 0 )
+			Marker( packet.mStartSample, sink );
+
+		Pulse rest[ ACURITE_RESYNC_HISTORY ];
+		size_t rest_count = mHistoryCount - end - 1;
+		memcpy( rest, mHistory + end + 1, rest_count * sizeof( Pulse ) );
+
+		mDecoder = trial;
+		Packet( packet, sink );
+		EndFrame( mHistory[ end ].mHigh );
+		mLastEdge = mHistory[ end ].mSample;
+		mHistoryCount = 0;
+
+		for( size_t i = 0; i < rest_count; i++ )
+			Edge( rest[ i ].mSample, rest[ i ].mHigh, sink );
+		return true;
+	}
+
+	if( going_rank > 0 )
+	{
+		TRACE( TRACE_PACKET, TRACE_RESYNC, mHistory[ going_start ].mSample, mHistoryCount - going_start, 0 );
+
+		// Still decoding: carry on from where the guess started
+		mDecoder = going;
+		mInFrame = true;
+		mFrameStart = mHistory[ going_start ].mSample;
+		memmove( mHistory, mHistory + going_start, ( mHistoryCount - going_start ) * sizeof( Pulse ) );
+		mHistoryCount -= going_start;
+		if( going_start > 0 )
+			Marker( mFrameStart, sink );
+		return true;
+	}
+
+	return false;
+}
+
+void AcuriteEdgeDecoder::Edges( const uint64_t* samples, size_t count, bool first_high, AcuriteDecodeSink& sink )
+{
+	bool high = first_high;
+	for( size_t i = 0; i < count; i++ )
+	{
+		Edge( samples[ i ], high, sink );
+		high = !high;
+	}
+}
+
+void AcuriteEdgeDecoder::Quiet( uint64_t sample, AcuriteDecodeSink& sink )
+{
+	if( !mHolding )
+		return;
+
+	// A quiet gap ends the segment, and with it any chance of another copy
+	if( sample - mLastEdge >= mSegmentGap )
+	{
+		Release( sink );
+		return;
+	}
+
+	if( sample - mHeld.mEndSample <= mRepeatWindow )
+		return;
+
+	// A copy already under way could still complete, unless its next pulse
+	// has run past anything the decoder accepts
+	if( mInFrame && mFrameStart - mHeld.mEndSample <= mRepeatWindow &&
+		sample - mLastEdge <= mDecoder.timing.bitWidth )
+		return;
+
+	Release( sink );
+}
+
+void AcuriteEdgeDecoder::Finish( AcuriteDecodeSink& sink )
+{
+	Release( sink );
+}
+
+void AcuriteEdgeDecoder::Marker( uint64_t sample, AcuriteDecodeSink& sink )
+{
+	if( mHolding )
+		mHeldMarkers.push_back( sample );
+	else
+		sink.OnMarker( sample );
+}
+
+void AcuriteEdgeDecoder::Release( AcuriteDecodeSink& sink )
+{
+	if( !mHolding )
+		return;
+
+	mHolding = false;
+	sink.OnPacket( mHeld );
+	for( size_t i = 0; i < mHeldMarkers.size(); i++ )
+		sink.OnMarker( mHeldMarkers[ i ] );
+	mHeldMarkers.clear();
+}
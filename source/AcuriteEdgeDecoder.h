@@ -0,0 +1,165 @@
+#ifndef ACURITE_EDGE_DECODER_H
+#define ACURITE_EDGE_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <vector>
+#include "decoders.h"
+#include "AcuriteMetrics.h"
+#include "AcuritePacket.h"
+
+// A quiet stretch this long always ends a packet, so decoding can start over
+// from scratch after it; the capture is split into segments there.
+#define ACURITE_SEGMENT_GAP_US 100000
+
+// Longest repeat window: a whole number of ms, and short of the segment gap,
+// so a held packet is always let go by the gap that ends its segment
+#define ACURITE_MAX_REPEAT_WINDOW_US ( ACURITE_SEGMENT_GAP_US - 1000 )
+
+// Pulses of the current frame kept for resynchronizing; a whole packet is
+// about 2 * ( NUM_SYNCS + 56 ) + 2
+#define ACURITE_RESYNC_HISTORY 256
+
+// Sensors send each reading as a burst of copies, one right after the
+// other; a packet starting this soon after the last one ended is taken to be
+// the next copy of the same burst (see AcuritePacket::mCopy).
+#define ACURITE_BURST_GAP_US 10000
+
+// A noisy channel may never go quiet. Past this many edges a segment is also
+// split at the next pulse longer than BIT_WIDTH, which no packet survives.
+#define ACURITE_SEGMENT_MAX_EDGES 65536
+
+// Decoding settings shared by everything that drives an AcuriteEdgeDecoder
+struct AcuriteDecoderOptions
+{
+	AcuriteDecoderOptions( uint32_t sample_rate_hz )
+	:	mSampleRateHz( sample_rate_hz ), mRepeatWindowUs( 0 ), mCalibrationEdges( 0 ),
+		mTiming( sample_rate_hz ), mCorrectBits( false ), mGlitchWidthUs( 0 ) {}
+
+	uint32_t mSampleRateHz;
+	// Copies of a packet starting this soon after the previous copy ended are
+	// folded into one (see AcuritePacket::mRepeats); 0 reports every copy.
+	// At most ACURITE_MAX_REPEAT_WINDOW_US (longer is taken as that), so all
+	// copies land in one segment.
+	uint32_t mRepeatWindowUs;
+	// AcuriteChannelDecoder fits the thresholds to this many edges from the
+	// start of the capture before decoding any (see AcuriteCalibrator); 0
+	// keeps the fixed ones.
+	uint32_t mCalibrationEdges;
+	// The thresholds to decode with: the fixed ones at mSampleRateHz, or the
+	// calibrated ones.
+	AcuRiteTiming mTiming;
+	// A packet failing its parity or checksum test by one bit is put right,
+	// and flagged ACURITE_PACKET_CORRECTED (see AcuriteCorrectPacket).
+	bool mCorrectBits;
+	// AcuriteChannelDecoder drops pulses shorter than this before decoding
+	// (see AcuriteGlitchFilter); 0 keeps them all. At most ACURITE_GLITCH_MAX_US.
+	uint32_t mGlitchWidthUs;
+};
+
+// Where decoded output goes.
+class AcuriteDecodeSink
+{
+public:
+	virtual ~AcuriteDecodeSink() {}
+
+	// Start of a candidate packet
+	virtual void OnMarker( uint64_t sample ) = 0;
+	// A finished packet (valid or not); packet.mEndSample is the edge that completed it
+	virtual void OnPacket( const AcuritePacket& packet ) = 0;
+};
+
+// Feeds edges (sample numbers) to an AcuRiteDecoder and turns its output into
+// markers and packets. Holds everything WorkerThread used to track per edge.
+//
+// With a repeat window, a valid packet is held back until it's clear no more
+// copies of it are coming, and markers arriving meanwhile wait behind it.
+//
+// When a frame fails, or ends in a packet that doesn't validate, the pulses
+// it's made of get another look before they're given up on (see Resync()).
+class AcuriteEdgeDecoder
+{
+public:
+	AcuriteEdgeDecoder( const AcuriteDecoderOptions& options );
+
+	// Start over as if freshly created, with previous_edge standing in for the
+	// edge before the next one. Call Finish() first to keep a held packet.
+	void Reset( uint64_t previous_edge );
+
+	// One edge; high is the line level after it.
+	void Edge( uint64_t sample, bool high, AcuriteDecodeSink& sink );
+
+	// A run of edges with alternating levels, the first one leaving the line at first_high.
+	void Edges( const uint64_t* samples, size_t count, bool first_high, AcuriteDecodeSink& sink );
+
+	// There is no edge up to and including sample: pass on a held packet if
+	// that rules out any more copies.
+	void Quiet( uint64_t sample, AcuriteDecodeSink& sink );
+	// No more edges are coming (before a Reset()): pass on a held packet.
+	void Finish( AcuriteDecodeSink& sink );
+	bool IsHolding() const { return mHolding; }
+
+	const AcuRiteTiming& GetTiming() const { return mDecoder.timing; }
+
+	// Counts since this decoder was created (Reset() keeps them)
+	const AcuriteMetrics& GetMetrics() const { return mMetrics; }
+
+	// Start of the packet being assembled or held, if any: nothing this
+	// decoder reports from now on starts earlier. ~0 when idle.
+	uint64_t GetPendingStart() const
+	{
+		if( mHolding )
+			return mHeld.mStartSample;
+		return mInFrame ? mFrameStart : ~(uint64_t)0;
+	}
+
+protected:
+	// A pulse fed to the decoder in the current frame
+	struct Pulse
+	{
+		uint64_t mSample; // the edge that ended it
+		uint64_t mWidth;
+		bool mHigh;       // line level after mSample (so the pulse itself was !mHigh)
+	};
+
+	void Marker( uint64_t sample, AcuriteDecodeSink& sink );
+	void Release( AcuriteDecodeSink& sink );
+	void Packet( AcuritePacket& packet, AcuriteDecodeSink& sink );
+	void EndFrame( bool high );
+	bool Correct( AcuritePacket& packet ) const;
+	void Measure( AcuritePacket& packet );
+	void Count( const AcuritePacket& packet );
+
+	bool Resync( AcuriteDecodeSink& sink );
+	int Replay( AcuRiteDecoder& decoder, size_t first, bool merge_glitches ) const;
+
+	AcuRiteDecoder mDecoder;
+	uint64_t mRepeatWindow; // samples; 0: no repeat folding
+	uint64_t mSegmentGap;   // ACURITE_SEGMENT_GAP_US in samples
+	bool mCorrectBits;
+	uint32_t mSampleRateHz;
+	uint64_t mBurstGap;     // ACURITE_BURST_GAP_US in samples
+	uint64_t mLastEdge;
+	uint64_t mFrameStart;
+	bool mInFrame;  // mFrameStart is valid
+	bool mSkipEdge; // a packet ended on a rising edge; drop the falling one
+
+	Pulse mHistory[ ACURITE_RESYNC_HISTORY ];
+	size_t mHistoryCount;
+
+	bool mHolding;  // mHeld is waiting for more copies
+	AcuritePacket mHeld;
+	std::vector< uint64_t > mHeldMarkers; // markers since mHeld ended
+
+	bool mInBurst;          // mBurstEnd is the last packet's end
+	uint64_t mBurstEnd;
+	uint8_t mBurstCopies;   // its mCopy
+
+	AcuriteMetrics mMetrics;
+	AcuriteMetricsWidthBins mWidthBins;
+	bool mInData; // mDataStart is the current frame's first data bit
+	std::chrono::steady_clock::time_point mDataStart;
+};
+
+#endif //ACURITE_EDGE_DECODER_H
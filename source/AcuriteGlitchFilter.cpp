@@ -0,0 +1,121 @@
+#include "AcuriteGlitchFilter.h"
+#include <string.h>
+
+// Edges checked at a time for any glitch at all, before being copied
+// through as they are
+#define GLITCH_CHUNK_EDGES 256
+
+AcuriteGlitchFilter::AcuriteGlitchFilter( uint64_t min_width )
+:	mMinWidth( min_width ),
+	mHolding( false ),
+	mHeld( 0 ),
+	mHeldHigh( false ),
+	mEdges( 0 ),
+	mFiltered( 0 )
+{
+}
+
+// Edge() without the counting
+inline bool AcuriteGlitchFilter::Step( uint64_t sample, bool high, uint64_t& out, bool& out_high )
+{
+	if( mHolding && sample - mHeld < mMinWidth )
+	{
+		// The held edge started a glitch, and this one ends it
+		mHolding = false;
+		mFiltered += 2;
+		return false;
+	}
+
+	bool clear = mHolding;
+	out = mHeld;
+	out_high = mHeldHigh;
+	mHolding = true;
+	mHeld = sample;
+	mHeldHigh = high;
+	return clear;
+}
+
+bool AcuriteGlitchFilter::Edge( uint64_t sample, bool high, uint64_t& out, bool& out_high )
+{
+	mEdges++;
+	if( mMinWidth == 0 )
+	{
+		out = sample;
+		out_high = high;
+		return true;
+	}
+	return Step( sample, high, out, out_high );
+}
+
+size_t AcuriteGlitchFilter::Edges( const uint64_t* samples, size_t count, bool first_high, uint64_t* out, bool& out_first_high )
+{
+	mEdges += count;
+	out_first_high = first_high;
+	if( mMinWidth == 0 )
+	{
+		memcpy( out, samples, count * sizeof *samples );
+		return count;
+	}
+
+	size_t n = 0;
+	bool high = first_high;
+	for( size_t chunk = 0; chunk < count; chunk += GLITCH_CHUNK_EDGES )
+	{
+		size_t end = chunk + GLITCH_CHUNK_EDGES < count ? chunk + GLITCH_CHUNK_EDGES : count;
+
+		// Branch free, so it vectorizes: is any pulse in the chunk too short?
+		uint64_t glitches = mHolding && samples[ chunk ] - mHeld < mMinWidth;
+		for( size_t i = chunk + 1; i < end; i++ )
+			glitches |= samples[ i ] - samples[ i - 1 ] < mMinWidth;
+
+		if( !glitches )
+		{
+			// Everything but the last edge is clear, and so is the held one
+			if( mHolding )
+			{
+				if( n == 0 )
+					out_first_high = mHeldHigh;
+				out[ n++ ] = mHeld;
+			}
+			else if( n == 0 )
+			{
+				out_first_high = high;
+			}
+			memcpy( out + n, samples + chunk, ( end - chunk - 1 ) * sizeof *samples );
+			n += end - chunk - 1;
+
+			mHolding = true;
+			mHeld = samples[ end - 1 ];
+			mHeldHigh = ( ( end - 1 - chunk ) & 1 ) ? !high : high;
+			if( ( end - chunk ) & 1 )
+				high = !high;
+			continue;
+		}
+
+		for( size_t i = chunk; i < end; i++ )
+		{
+			uint64_t edge;
+			bool edge_high;
+			if( Step( samples[ i ], high, edge, edge_high ) )
+			{
+				if( n == 0 )
+					out_first_high = edge_high;
+				out[ n++ ] = edge;
+			}
+			high = !high;
+		}
+	}
+	return n;
+}
+
+bool AcuriteGlitchFilter::Release( uint64_t sample, uint64_t& out, bool& out_high )
+{
+	// The next edge comes after sample, so more than sample - mHeld from the held one
+	if( !mHolding || sample < mHeld || sample - mHeld < mMinWidth - 1 )
+		return false;
+
+	mHolding = false;
+	out = mHeld;
+	out_high = mHeldHigh;
+	return true;
+}
@@ -0,0 +1,60 @@
+#ifndef ACURITE_GLITCH_FILTER_H
+#define ACURITE_GLITCH_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Widest glitch that may be filtered out; the shortest pulse a sensor sends
+// on purpose is its 100 uS stop bit (see AcuriteSimulationTiming.h)
+#define ACURITE_GLITCH_MAX_US 90
+
+// Removes pulses shorter than a minimum width before they reach the decoder,
+// on the edge stream. A short pulse takes both its edges with it, which
+// joins the pulses either side into one; a run of them (a noise burst)
+// disappears pair by pair, and the levels keep alternating.
+//
+// Whether an edge starts a glitch is only known from the edge after it, so
+// the latest edge is always held back until the next one comes in, or until
+// Release() says there's none within the minimum width.
+class AcuriteGlitchFilter
+{
+public:
+	// min_width in samples; 0 passes everything straight through
+	AcuriteGlitchFilter( uint64_t min_width );
+
+	// One edge, high being the line level after it. Returns true with an
+	// edge that's now clear in out/out_high.
+	bool Edge( uint64_t sample, bool high, uint64_t& out, bool& out_high );
+
+	// A run of edges with alternating levels, the first one leaving the line
+	// at first_high. The edges that are now clear go into out, which needs
+	// room for count + 1; returns how many, with the level after the first
+	// in out_first_high.
+	size_t Edges( const uint64_t* samples, size_t count, bool first_high, uint64_t* out, bool& out_first_high );
+
+	// There is no edge up to and including sample: returns true with the
+	// held edge, if that makes it clear.
+	bool Release( uint64_t sample, uint64_t& out, bool& out_high );
+
+	// The edge held back, if any
+	bool IsHolding() const { return mHolding; }
+	uint64_t GetHeld() const { return mHeld; }
+
+	uint64_t GetMinWidth() const { return mMinWidth; }
+	// Edges seen, and edges dropped as glitches
+	uint64_t GetEdges() const { return mEdges; }
+	uint64_t GetFiltered() const { return mFiltered; }
+
+protected:
+	bool Step( uint64_t sample, bool high, uint64_t& out, bool& out_high );
+
+	uint64_t mMinWidth;
+	bool mHolding;
+	uint64_t mHeld;
+	bool mHeldHigh;
+
+	uint64_t mEdges;
+	uint64_t mFiltered;
+};
+
+#endif //ACURITE_GLITCH_FILTER_H
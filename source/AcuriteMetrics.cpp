@@ -0,0 +1,89 @@
+#include "AcuriteMetrics.h"
+#include <string.h>
+
+static const char* const WidthClassNames[ ACURITE_NUM_WIDTHS ] =
+{
+	"None", "Short", "Zero", "One", "Sync", "Long sync", "Long"
+};
+
+void AcuriteMetrics::Clear()
+{
+	memset( this, 0, sizeof *this );
+}
+
+template< size_t N >
+static void AddCounts( uint64_t ( &counts )[ N ], const uint64_t ( &others )[ N ] )
+{
+	for( size_t i = 0; i < N; i++ )
+		counts[ i ] += others[ i ];
+}
+
+void AcuriteMetrics::Merge( const AcuriteMetrics& other )
+{
+	mEdges += other.mEdges;
+	mFiltered += other.mFiltered;
+	mSkipped += other.mSkipped;
+	mSyncRuns += other.mSyncRuns;
+	mT3Aborts += other.mT3Aborts;
+	mWidthResets += other.mWidthResets;
+	AddCounts( mParityFailures, other.mParityFailures );
+	mChecksumFailures += other.mChecksumFailures;
+	mBadSizes += other.mBadSizes;
+	mPackets += other.mPackets;
+	mCorrected += other.mCorrected;
+	AddCounts( mWidths, other.mWidths );
+	AddCounts( mDecodeTimes, other.mDecodeTimes );
+}
+
+void AcuriteMetrics::Print( std::ostream& out ) const
+{
+	out << "Edges seen," << mEdges << std::endl;
+	out << "Edges filtered," << mFiltered << std::endl;
+	out << "Edges skipped," << mSkipped << std::endl;
+	out << "Sync runs," << mSyncRuns << std::endl;
+	out << "T3 aborts," << mT3Aborts << std::endl;
+	out << "Width resets," << mWidthResets << std::endl;
+	for( int i = 1; i <= 5; i++ )
+		out << "Parity failures in byte " << i << "," << mParityFailures[ i ] << std::endl;
+	out << "Checksum failures," << mChecksumFailures << std::endl;
+	out << "Bad sizes," << mBadSizes << std::endl;
+	out << "Packets decoded," << mPackets << std::endl;
+	out << "Packets corrected," << mCorrected << std::endl;
+
+	// The fixed thresholds at 1 MHz are in uS. Each bin gets the class of its
+	// widest pulse, which is all of them but for a "<=" limit's bin, where
+	// only the first uS belongs to the class below.
+	AcuRiteDecoder decoder;
+	out << std::endl << "Pulse width [uS],Class,Pulses" << std::endl;
+	for( int bin = 0; bin < ACURITE_METRICS_WIDTH_BINS; bin++ )
+	{
+		word width = bin * ACURITE_METRICS_WIDTH_BIN_US;
+		out << width;
+		if( bin == ACURITE_METRICS_WIDTH_BINS - 1 )
+			out << "+";
+		out << "," << WidthClassNames[ decoder.classify( width + ACURITE_METRICS_WIDTH_BIN_US - 1 ) ] << "," << mWidths[ bin ] << std::endl;
+	}
+
+	out << std::endl << "Decode time [nS],Packets" << std::endl;
+	for( int bin = 0; bin < ACURITE_METRICS_TIME_BINS; bin++ )
+		if( mDecodeTimes[ bin ] != 0 )
+			out << ( (uint64_t)1 << bin ) << "," << mDecodeTimes[ bin ] << std::endl;
+}
+
+AcuriteMetricsWidthBins::AcuriteMetricsWidthBins( uint32_t sample_rate_hz )
+{
+	uint64_t bin_samples = (uint64_t)sample_rate_hz * ACURITE_METRICS_WIDTH_BIN_US;
+	mScale = ( ( (uint64_t)1000000 << 32 ) + bin_samples - 1 ) / bin_samples;
+	mLimit = AcuRiteTiming::atLeast( ( ACURITE_METRICS_WIDTH_BINS - 1 ) * ACURITE_METRICS_WIDTH_BIN_US, sample_rate_hz );
+}
+
+unsigned AcuriteMetricsTimeBin( uint64_t ns )
+{
+	unsigned bin = 0;
+	while( ns > 1 && bin < ACURITE_METRICS_TIME_BINS - 1 )
+	{
+		ns >>= 1;
+		bin++;
+	}
+	return bin;
+}
@@ -0,0 +1,69 @@
+#ifndef ACURITE_METRICS_H
+#define ACURITE_METRICS_H
+
+#include <stdint.h>
+#include <ostream>
+#include "decoders.h"
+
+// Pulse-width histogram: bins this many uS wide, the last one taking
+// everything from there up. The fixed class thresholds (see decoders.h) all
+// fall on bin edges.
+#define ACURITE_METRICS_WIDTH_BIN_US 10
+#define ACURITE_METRICS_WIDTH_BINS 128
+// Decode time histogram: bin i counts times in [2^i, 2^(i+1)) nS
+#define ACURITE_METRICS_TIME_BINS 40
+
+// What the decoding pipeline did, for working out why packets went missing.
+// Every decoder counts into its own, unshared, so keeping count costs a few
+// increments per pulse; readers Merge() them into a total.
+struct AcuriteMetrics
+{
+	AcuriteMetrics() { Clear(); }
+
+	void Clear();
+	// Add other's counts to these; a new counter needs adding there too
+	void Merge( const AcuriteMetrics& other );
+
+	uint64_t mEdges;         // into the glitch filter
+	uint64_t mFiltered;      // dropped by it
+	uint64_t mSkipped;       // read but never decoded (see AcuritePreambleSeeker)
+	uint64_t mSyncRuns;      // frames that got through their sync bits to the first data bit
+	uint64_t mT3Aborts;      // frames that started on data after the wrong number of sync bits
+	uint64_t mWidthResets;   // frames given up on a pulse no class fits in their state
+	uint64_t mParityFailures[ 7 ]; // packets with a bad parity bit, by byte (1-5)
+	uint64_t mChecksumFailures;
+	uint64_t mBadSizes;
+	uint64_t mPackets;       // packets that validated, corrections included
+	uint64_t mCorrected;
+	// Every pulse decoded, by width (see AcuriteMetricsWidthBins). The
+	// classes are told apart when printing, so counting doesn't need to
+	// classify; with calibrated thresholds they're only approximate.
+	uint64_t mWidths[ ACURITE_METRICS_WIDTH_BINS ];
+	uint64_t mDecodeTimes[ ACURITE_METRICS_TIME_BINS ]; // from the first data bit to the packet
+
+	// A report, one "name,value" line per counter, then the histograms as tables
+	// (the widths with the fixed class each bin falls in)
+	void Print( std::ostream& out ) const;
+};
+
+// Maps a pulse width in samples to its ACURITE_METRICS_WIDTH_BIN_US bin with
+// a multiply and a shift
+class AcuriteMetricsWidthBins
+{
+public:
+	AcuriteMetricsWidthBins( uint32_t sample_rate_hz );
+
+	unsigned Bin( uint64_t width ) const
+	{
+		return width >= mLimit ? ACURITE_METRICS_WIDTH_BINS - 1 : (unsigned)( ( width * mScale ) >> 32 );
+	}
+
+protected:
+	uint64_t mScale; // bins per sample, in 32.32 fixed point
+	uint64_t mLimit; // samples in all but the last bin
+};
+
+// The histogram bin for a time in nS
+unsigned AcuriteMetricsTimeBin( uint64_t ns );
+
+#endif //ACURITE_METRICS_H
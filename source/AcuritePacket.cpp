@@ -0,0 +1,260 @@
+#include "AcuritePacket.h"
+#include <string.h>
+
+void AcuriteDecodePacket(const uint8_t *data, int size, AcuritePacket &packet)
+{
+  packet.mFlags = 0;
+  packet.mParityByte = 0;
+  packet.mRepeats = 0;
+  packet.mCorrectedBit = 0;
+  packet.mSyncs = 0;
+  packet.mCopy = 0;
+  packet.mMeanDeviation = 0;
+  packet.mMaxDeviation = 0;
+  packet.mMinMargin = 0;
+  packet.mSize = size;
+  packet.mInput = 0;
+  packet.mInputMask = 1;
+  packet.mFirstCopy = 0;
+  packet.mPreviousFromSensor = ACURITE_ARENA_FULL;
+  memset(packet.mData, 0, sizeof packet.mData);
+  memcpy(packet.mData, data, size < 7 ? size : 7);
+
+  if (size != 7) {
+    packet.mFlags |= ACURITE_PACKET_BAD_SIZE;
+    return;
+  }
+
+  uint64_t v = AcuriteLoadPacket(data);
+
+  // Check parity bits. (Byte 0 and byte 7 have no parity bits.)
+  uint64_t parity = AcuriteParityErrors(v);
+  if (parity) {
+    packet.mFlags |= ACURITE_PACKET_BAD_PARITY;
+    packet.mParityByte = 1; // report the first bad one
+    while (!(parity >> (8 * packet.mParityByte) & 1))
+      packet.mParityByte++;
+    return;
+  }
+
+  // Check checksum.
+  if (!AcuriteChecksumOk(v)) {
+    packet.mFlags |= ACURITE_PACKET_BAD_CHECKSUM;
+    return;
+  }
+
+  // Data is good! Pull out the fields...
+
+  // Source A/B/C and ID
+  packet.mChannel = (data[0] & 0xC0) == 0xC0 ? 'A' :
+    (data[0] & 0xC0) == 0x80 ? 'B' :
+    (data[0] & 0xC0) == 0x00 ? 'C' :
+    'x';
+  packet.mSensorId = (data[0] & 0x3F) << 7 | (data[1] & 0x7F);
+  packet.mHumidity = data[3] & 0x7f;
+
+  // Temperature
+  packet.mRawTemperature = ((data[4] & 0x0F) << 7) | (data[5] & 0x7F);
+}
+
+char *AcuriteFormatText(char *out, const char *text)
+{
+  while (*text)
+    *out++ = *text++;
+  return out;
+}
+
+char *AcuriteFormatUnsigned(char *out, uint64_t value)
+{
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n)
+    *out++ = digits[--n];
+  return out;
+}
+
+char *AcuriteFormatHex(char *out, uint64_t value, int minDigits)
+{
+  char digits[16];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789ABCDEF"[value & 0xF];
+    value >>= 4;
+  } while (value || n < minDigits);
+  while (n)
+    *out++ = digits[--n];
+  return out;
+}
+
+char *AcuriteFormatTenths(char *out, int tenths)
+{
+  if (tenths < 0) {
+    *out++ = '-';
+    tenths = -tenths;
+  }
+  out = AcuriteFormatUnsigned(out, tenths / 10);
+  *out++ = '.';
+  *out++ = '0' + tenths % 10;
+  return out;
+}
+
+int AcuriteFormatPacket(const AcuritePacket &packet, char *output)
+{
+  const uint8_t *data = packet.mData;
+  char *out = output;
+
+  if (packet.mFlags & ACURITE_PACKET_BAD_SIZE) {
+    out = AcuriteFormatText(out, "Invalid data (not 7 bytes)");
+  } else if (packet.mFlags & ACURITE_PACKET_BAD_PARITY) {
+    int i = packet.mParityByte;
+    out = AcuriteFormatText(out, "Parity failure in byte ");
+    out = AcuriteFormatUnsigned(out, i);
+    out = AcuriteFormatText(out, " [0x");
+    out = AcuriteFormatHex(out, data[i], 2);
+    out = AcuriteFormatText(out, " !~ 0x");
+    out = AcuriteFormatHex(out, AcuriteParityBit(data[i]), 2);
+    out = AcuriteFormatText(out, "]");
+  } else if (packet.mFlags & ACURITE_PACKET_BAD_CHECKSUM) {
+    unsigned char cksum = 0;
+    for (int i=0; i<=5; i++) {
+      cksum += data[i];
+    }
+    out = AcuriteFormatText(out, "Checksum failure (0x");
+    out = AcuriteFormatHex(out, cksum, 1);
+    out = AcuriteFormatText(out, " vs. 0x");
+    out = AcuriteFormatHex(out, data[6], 1);
+    out = AcuriteFormatText(out, ")");
+  } else {
+    // e.g. "Channel A 0x1A3 45% 21.5 C (70.7 F)"
+    out = AcuriteFormatText(out, "Channel ");
+    *out++ = packet.mChannel;
+    out = AcuriteFormatText(out, " 0x");
+    out = AcuriteFormatHex(out, packet.mSensorId, 1);
+    *out++ = ' ';
+    out = AcuriteFormatUnsigned(out, packet.mHumidity);
+    out = AcuriteFormatText(out, "% ");
+    out = AcuriteFormatTenths(out, AcuriteCelsiusTenths(packet));
+    out = AcuriteFormatText(out, " C (");
+    out = AcuriteFormatTenths(out, AcuriteFahrenheitTenths(packet));
+    out = AcuriteFormatText(out, " F)");
+
+    if (packet.mRepeats) {
+      out = AcuriteFormatText(out, " x");
+      out = AcuriteFormatUnsigned(out, packet.mRepeats + 1);
+    }
+
+    if (packet.mFlags & ACURITE_PACKET_CORRECTED) {
+      out = AcuriteFormatText(out, " (corrected bit ");
+      out = AcuriteFormatUnsigned(out, packet.mCorrectedBit);
+      out = AcuriteFormatText(out, ")");
+    }
+  }
+
+  *out = 0;
+  return out - output;
+}
+
+int AcuriteFormatQuality(const AcuritePacket &packet, char *output)
+{
+  char *out = output;
+
+  out = AcuriteFormatUnsigned(out, packet.mSyncs);
+  out = AcuriteFormatText(out, " syncs, copy ");
+  out = AcuriteFormatUnsigned(out, packet.mCopy + 1);
+  out = AcuriteFormatText(out, ", deviation ");
+  out = AcuriteFormatUnsigned(out, packet.mMeanDeviation);
+  *out++ = '/';
+  out = AcuriteFormatUnsigned(out, packet.mMaxDeviation);
+  out = AcuriteFormatText(out, " uS, margin ");
+  out = AcuriteFormatUnsigned(out, packet.mMinMargin);
+  out = AcuriteFormatText(out, " uS");
+
+  *out = 0;
+  return out - output;
+}
+
+uint64_t AcuriteValidatePackets(const uint8_t *packets, size_t count)
+{
+  // Branch free, so the compiler can run several packets side by side
+  uint64_t valid = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t v = AcuriteLoadPacket(packets + 7 * i);
+    uint64_t ok = (AcuriteParityErrors(v) == 0) & AcuriteChecksumOk(v);
+    valid |= ok << i;
+  }
+  return valid;
+}
+
+bool AcuriteCorrectPacket(AcuritePacket &packet, const uint32_t *margins)
+{
+  if (!(packet.mFlags & (ACURITE_PACKET_BAD_PARITY | ACURITE_PACKET_BAD_CHECKSUM)))
+    return false;
+
+  // Every single-bit flip of the packet, checked in one go. A flip fixes at
+  // most one byte's parity, so most of them fail straight away.
+  uint8_t candidates[56 * 7];
+  for (int i = 0; i < 56; i++) {
+    memcpy(candidates + 7 * i, packet.mData, 7);
+    candidates[7 * i + i / 8] ^= 0x80 >> (i % 8);
+  }
+  uint64_t valid = AcuriteValidatePackets(candidates, 56);
+
+  // The best flip has to stand out: a checksum error alone can often be
+  // fixed in byte 0 or in byte 6, and unless one of the two bits was read
+  // far less clearly than the other, picking one is a guess
+  int best = -1, second = -1;
+  for (int i = 0; i < 56; i++) {
+    if (!(valid >> i & 1))
+      continue;
+    if (best < 0 || margins[i] < margins[best]) {
+      second = best;
+      best = i;
+    } else if (second < 0 || margins[i] < margins[second]) {
+      second = i;
+    }
+  }
+  if (best < 0 || (second >= 0 && margins[second] < 4 * (uint64_t)margins[best] + 1))
+    return false;
+
+  AcuriteDecodePacket(candidates + 7 * best, 7, packet);
+  packet.mFlags |= ACURITE_PACKET_CORRECTED;
+  packet.mCorrectedBit = best;
+  return true;
+}
+
+AcuritePacketArena::AcuritePacketArena() : mCount(0)
+{
+  memset(mBlocks, 0, sizeof mBlocks);
+  memset(mLastFromSensor, 0xFF, sizeof mLastFromSensor);
+  memset(mSensorCounts, 0, sizeof mSensorCounts);
+}
+
+AcuritePacketArena::~AcuritePacketArena()
+{
+  for (uint64_t i = 0; i < ACURITE_ARENA_MAX_BLOCKS && mBlocks[i] != NULL; i++)
+    delete[] mBlocks[i];
+}
+
+uint64_t AcuritePacketArena::Add(const AcuritePacket &packet)
+{
+  uint64_t block = mCount / ACURITE_ARENA_BLOCK_SIZE;
+  if (block >= ACURITE_ARENA_MAX_BLOCKS)
+    return ACURITE_ARENA_FULL;
+
+  if (mBlocks[block] == NULL)
+    mBlocks[block] = new AcuritePacket[ACURITE_ARENA_BLOCK_SIZE];
+
+  AcuritePacket &stored = mBlocks[block][mCount % ACURITE_ARENA_BLOCK_SIZE];
+  stored = packet;
+  stored.mPreviousFromSensor = ACURITE_ARENA_FULL;
+  if (!(packet.mFlags & ACURITE_PACKET_ERRORS)) {
+    stored.mPreviousFromSensor = mLastFromSensor[packet.mSensorId];
+    mLastFromSensor[packet.mSensorId] = mCount;
+    mSensorCounts[packet.mSensorId]++;
+  }
+  return mCount++;
+}
@@ -0,0 +1,191 @@
+#ifndef ACURITE_PACKET_H
+#define ACURITE_PACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// AcuritePacket::mFlags
+#define ACURITE_PACKET_BAD_SIZE     0x01 // decoder didn't hand back 7 bytes
+#define ACURITE_PACKET_BAD_PARITY   0x02 // mParityByte says which byte failed
+#define ACURITE_PACKET_BAD_CHECKSUM 0x04
+#define ACURITE_PACKET_ERRORS       ( ACURITE_PACKET_BAD_SIZE | ACURITE_PACKET_BAD_PARITY | ACURITE_PACKET_BAD_CHECKSUM )
+#define ACURITE_PACKET_CORRECTED    0x08 // valid after flipping mCorrectedBit (see AcuriteCorrectPacket)
+
+// One decoded packet, kept in binary form; text is only produced when the
+// GUI or an export asks for it. The sensor fields are meaningless when any
+// ACURITE_PACKET_ERRORS flag is set.
+struct AcuritePacket
+{
+	uint64_t mStartSample;
+	uint64_t mEndSample;
+	uint16_t mSensorId;
+	uint16_t mRawTemperature; // 11 bits: tenths of a degree C, offset by 1024
+	uint8_t mChannel;         // 'A', 'B', 'C' or 'x'
+	uint8_t mHumidity;        // percent
+	uint8_t mFlags;
+	uint8_t mSize;            // bytes the decoder returned
+	uint8_t mData[ 7 ];       // the packet as received
+	uint8_t mParityByte;      // with ACURITE_PACKET_BAD_PARITY
+	uint8_t mRepeats;         // further copies folded into this frame
+	uint8_t mCorrectedBit;    // with ACURITE_PACKET_CORRECTED: 0 is the first bit received, 55 the last
+
+	// Signal quality, from the pulses the decoder read (see AcuriteEdgeDecoder::Measure)
+	uint8_t mSyncs;           // sync bits before the data
+	uint8_t mCopy;            // copies of the burst received before this one (see ACURITE_BURST_GAP_US)
+	uint16_t mMeanDeviation;  // uS the data bits' high and low halves were off the nominal widths, on average
+	uint16_t mMaxDeviation;   // ... and at worst
+	uint16_t mMinMargin;      // uS the closest data bit was from being read as something else
+
+	// Receiver bookkeeping for multi-channel captures
+	uint8_t mInput;           // which input channel (0 = the first) decoded it
+	uint8_t mInputMask;       // inputs that have heard this transmission so far, this one included
+	uint64_t mFirstCopy;      // arena index of the earliest copy of this transmission (or its own)
+
+	// Arena index of the same sensor's previous valid packet, or
+	// ACURITE_ARENA_FULL; set by AcuritePacketArena::Add()
+	uint64_t mPreviousFromSensor;
+};
+
+// Validate a decoder's output and fill in everything but the sample range.
+void AcuriteDecodePacket( const uint8_t* data, int size, AcuritePacket& packet );
+
+// Try to make a packet that failed its parity or checksum test valid by
+// flipping a single bit. margins[i] is how close bit i (in arrival order)
+// came to being read the other way (see AcuRiteDecoder::margins); of the
+// flips that pass every check, the one with the smallest margin is taken,
+// if it's well clear of the next. Returns false, leaving packet alone,
+// otherwise. packet must be straight from AcuriteDecodePacket().
+bool AcuriteCorrectPacket( AcuritePacket& packet, const uint32_t* margins );
+
+// A 7-byte packet in one word, byte i in bits 8i..8i+7 (the top byte is 0).
+static inline uint64_t AcuriteLoadPacket( const uint8_t* data )
+{
+	uint64_t v = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	// Two overlapping 4-byte loads (byte 3 lands in both, identically); a
+	// 7-byte memcpy into v goes through memory and stalls the load after it
+	uint32_t lo, hi;
+	memcpy( &lo, data, 4 );
+	memcpy( &hi, data + 3, 4 );
+	v = lo | ( (uint64_t)hi << 24 );
+#else
+	for( int i = 0; i < 7; i++ )
+		v |= (uint64_t)data[ i ] << ( 8 * i );
+#endif
+	return v;
+}
+
+// Parity of every byte of v at once, left in bit 0 of each byte.
+static inline uint64_t AcuriteByteParity( uint64_t v )
+{
+	v ^= ( v >> 4 ) & 0x0F0F0F0F0F0F0F0Full;
+	v ^= ( v >> 2 ) & 0x0303030303030303ull;
+	v ^= ( v >> 1 ) & 0x0101010101010101ull;
+	return v & 0x0101010101010101ull;
+}
+
+// Bit 7 for a byte whose low 7 bits are b: set when they have odd parity,
+// which makes the whole byte even. Bytes 1-5 of a packet carry one.
+static inline uint8_t AcuriteParityBit( uint8_t b )
+{
+	return (uint8_t)( AcuriteByteParity( b & 0x7F ) << 7 );
+}
+
+// Bytes 1-5 of a loaded packet whose parity bit is wrong, as bit 0 of each byte
+static inline uint64_t AcuriteParityErrors( uint64_t v )
+{
+	return AcuriteByteParity( v ) & 0x0000010101010100ull;
+}
+
+// Whether bytes 0-5 of a loaded packet add up to byte 6 (mod 256).
+static inline bool AcuriteChecksumOk( uint64_t v )
+{
+	// Pairs of bytes into 16-bit lanes, then all lanes into the top one
+	uint64_t sums = ( v & 0x000000FF00FF00FFull ) + ( ( v >> 8 ) & 0x000000FF00FF00FFull );
+	return ( ( sums * 0x0001000100010001ull ) >> 48 & 0xFF ) == ( v >> 48 & 0xFF );
+}
+
+// Checks count (at most 64) candidate packets stored back to back, 7 bytes
+// each. Bit i of the result is set if packet i passes both the parity and
+// the checksum test, i.e. AcuriteDecodePacket() would find no error.
+uint64_t AcuriteValidatePackets( const uint8_t* packets, size_t count );
+
+// Temperature in tenths of a degree, without going through floating point.
+// Only meaningful for a packet with no ACURITE_PACKET_ERRORS.
+static inline int AcuriteCelsiusTenths( const AcuritePacket& packet )
+{
+	return (int)packet.mRawTemperature - 1024;
+}
+
+static inline int AcuriteFahrenheitTenths( const AcuritePacket& packet )
+{
+	// F * 100 = C * 10 * 18 + 3200, rounded to tenths away from zero
+	int hundredths = AcuriteCelsiusTenths( packet ) * 18 + 3200;
+	return hundredths >= 0 ? ( hundredths + 5 ) / 10 : -( ( 5 - hundredths ) / 10 );
+}
+
+// Small allocation-free formatters for display text, so none of it goes
+// through printf: each appends to out and returns the new end. Nothing is
+// NUL terminated until the caller does it.
+char* AcuriteFormatText( char* out, const char* text );
+char* AcuriteFormatUnsigned( char* out, uint64_t value );
+// upper case, at least min_digits digits
+char* AcuriteFormatHex( char* out, uint64_t value, int min_digits );
+// a signed count of tenths, e.g. -805 as "-80.5"
+char* AcuriteFormatTenths( char* out, int tenths );
+
+// Text for the bubble/table/export; output needs room for 128 characters.
+// Returns the length written.
+int AcuriteFormatPacket( const AcuritePacket& packet, char* output );
+
+// The signal quality fields as text, e.g. "4 syncs, copy 2, deviation
+// 12/40 uS, margin 55 uS"; output needs room for 96 characters. Returns the
+// length written.
+int AcuriteFormatQuality( const AcuritePacket& packet, char* output );
+
+#define ACURITE_ARENA_BLOCK_SIZE 4096  // packets per block
+#define ACURITE_ARENA_MAX_BLOCKS 16384 // 64M packets
+#define ACURITE_ARENA_FULL 0xFFFFFFFFFFFFFFFFull
+#define ACURITE_NUM_SENSOR_IDS 8192    // AcuritePacket::mSensorId is 13 bits
+
+// Append-only packet store. Packets live in fixed-size blocks that are never
+// moved, so a reader may look at any index it has been handed (e.g. through
+// a committed frame) while the writer keeps appending.
+//
+// Valid packets are also indexed by sensor as they come in: each is chained
+// to the sensor's previous one, so listing a sensor's k packets takes k
+// steps however many there are in all. The index heads change with every
+// Add(), so only the writer may read them; other threads get a published
+// copy (see AcuriteAnalyzerResults::Commit()).
+class AcuritePacketArena
+{
+public:
+	AcuritePacketArena();
+	~AcuritePacketArena();
+
+	// Returns the new packet's index, or ACURITE_ARENA_FULL.
+	uint64_t Add( const AcuritePacket& packet );
+	const AcuritePacket& Get( uint64_t index ) const
+	{
+		return mBlocks[ index / ACURITE_ARENA_BLOCK_SIZE ][ index % ACURITE_ARENA_BLOCK_SIZE ];
+	}
+	uint64_t GetCount() const { return mCount; }
+
+	// The sensor's latest valid packet, or ACURITE_ARENA_FULL; follow
+	// AcuritePacket::mPreviousFromSensor from there for the rest, newest first.
+	uint64_t GetLastFromSensor( uint16_t id ) const { return mLastFromSensor[ id ]; }
+	uint64_t GetSensorPacketCount( uint16_t id ) const { return mSensorCounts[ id ]; }
+
+protected:
+	AcuritePacket* mBlocks[ ACURITE_ARENA_MAX_BLOCKS ];
+	uint64_t mCount;
+	uint64_t mLastFromSensor[ ACURITE_NUM_SENSOR_IDS ];
+	uint64_t mSensorCounts[ ACURITE_NUM_SENSOR_IDS ];
+
+private:
+	AcuritePacketArena( const AcuritePacketArena& );
+	AcuritePacketArena& operator=( const AcuritePacketArena& );
+};
+
+#endif //ACURITE_PACKET_H
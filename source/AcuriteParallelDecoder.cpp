@@ -0,0 +1,117 @@
+#include "AcuriteParallelDecoder.h"
+
+// Segments queued or decoding per worker before Submit() waits
+#define SEGMENTS_IN_FLIGHT_PER_THREAD 4
+
+namespace
+{
+	// Records a segment's decoder output for replay on the analyzer's thread
+	class SegmentRecorder : public AcuriteDecodeSink
+	{
+	public:
+		SegmentRecorder( AcuriteSegment& segment ) : mSegment( segment ) {}
+
+		virtual void OnMarker( uint64_t sample )
+		{
+			AcuriteSegment::Event event = { sample, AcuriteSegment::MARKER };
+			mSegment.mEvents.push_back( event );
+		}
+
+		virtual void OnPacket( const AcuritePacket& packet )
+		{
+			AcuriteSegment::Event event = { packet.mEndSample, (uint32_t)mSegment.mPackets.size() };
+			mSegment.mPackets.push_back( packet );
+			mSegment.mEvents.push_back( event );
+		}
+
+	protected:
+		AcuriteSegment& mSegment;
+	};
+}
+
+AcuriteParallelDecoder::AcuriteParallelDecoder( unsigned threads, const AcuriteDecoderOptions& options )
+:	mOptions( options ),
+	mMaxInFlight( (uint64_t)threads * SEGMENTS_IN_FLIGHT_PER_THREAD ),
+	mNextSequence( 0 ),
+	mNextEmit( 0 ),
+	mPool( new AcuriteThreadPool( threads ) )
+{
+}
+
+AcuriteParallelDecoder::~AcuriteParallelDecoder()
+{
+	// Let the workers finish before throwing away what they produce
+	mPool.reset();
+
+	std::map< uint64_t, AcuriteSegment* >::iterator it;
+	for( it = mFinished.begin(); it != mFinished.end(); ++it )
+		delete it->second;
+}
+
+void AcuriteParallelDecoder::Submit( AcuriteSegment* segment, AcuriteDecodeSink& sink )
+{
+	segment->mSequence = mNextSequence++;
+	mPool->Submit( std::bind( &AcuriteParallelDecoder::Decode, this, segment ) );
+
+	Collect( sink, mNextSequence > mMaxInFlight ? mNextSequence - mMaxInFlight : 0 );
+}
+
+void AcuriteParallelDecoder::Flush( AcuriteDecodeSink& sink )
+{
+	Collect( sink, mNextSequence );
+}
+
+// Runs on a pool thread
+void AcuriteParallelDecoder::Decode( AcuriteSegment* segment )
+{
+	AcuriteEdgeDecoder decoder( mOptions );
+	SegmentRecorder recorder( *segment );
+
+	decoder.Reset( segment->mPreviousEdge );
+	if( !segment->mEdges.empty() )
+		decoder.Edges( &segment->mEdges[ 0 ], segment->mEdges.size(), segment->mFirstHigh, recorder );
+	decoder.Finish( recorder );
+	segment->mMetrics = decoder.GetMetrics();
+	std::vector< uint64_t >().swap( segment->mEdges );
+
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		mFinished[ segment->mSequence ] = segment;
+	}
+	mFinishedSignal.notify_all();
+}
+
+// Replays finished segments in sequence; waits until at least 'until' have gone out.
+void AcuriteParallelDecoder::Collect( AcuriteDecodeSink& sink, uint64_t until )
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+	for( ;; )
+	{
+		std::map< uint64_t, AcuriteSegment* >::iterator it = mFinished.find( mNextEmit );
+		if( it != mFinished.end() )
+		{
+			AcuriteSegment* segment = it->second;
+			mFinished.erase( it );
+			mNextEmit++;
+			lock.unlock();
+
+			for( size_t i = 0; i < segment->mEvents.size(); i++ )
+			{
+				const AcuriteSegment::Event& event = segment->mEvents[ i ];
+				if( event.mPacket == AcuriteSegment::MARKER )
+					sink.OnMarker( event.mSample );
+				else
+					sink.OnPacket( segment->mPackets[ event.mPacket ] );
+			}
+			mMetrics.Merge( segment->mMetrics );
+			delete segment;
+
+			lock.lock();
+			continue;
+		}
+
+		if( mNextEmit >= until )
+			break;
+		mFinishedSignal.wait( lock );
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef ACURITE_PARALLEL_DECODER_H
+#define ACURITE_PARALLEL_DECODER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "AcuriteEdgeDecoder.h"
+#include "AcuriteThreadPool.h"
+
+// A run of edges between two quiet gaps (see ACURITE_SEGMENT_GAP_US). No
+// packet spans a gap, so each segment decodes on its own.
+struct AcuriteSegment
+{
+	AcuriteSegment( uint64_t previous_edge, bool first_high )
+	:	mPreviousEdge( previous_edge ), mFirstHigh( first_high ), mSequence( 0 ) {}
+
+	uint64_t mPreviousEdge; // last edge before the gap
+	bool mFirstHigh;        // line level after mEdges[0]
+	std::vector< uint64_t > mEdges;
+
+	// Decoder output, in sample order: a marker, or an index into mPackets
+	struct Event
+	{
+		uint64_t mSample;
+		uint32_t mPacket;
+	};
+	enum { MARKER = 0xFFFFFFFF };
+	std::vector< Event > mEvents;
+	std::vector< AcuritePacket > mPackets;
+	AcuriteMetrics mMetrics;
+
+	uint64_t mSequence;
+};
+
+// Decodes segments on a thread pool, one AcuriteEdgeDecoder per segment, and
+// hands the results back in the order the segments were submitted.
+class AcuriteParallelDecoder
+{
+public:
+	AcuriteParallelDecoder( unsigned threads, const AcuriteDecoderOptions& options );
+	~AcuriteParallelDecoder();
+
+	// Takes ownership of segment. Also passes every segment that has finished
+	// (in order) to sink, and blocks while too many are still in flight.
+	void Submit( AcuriteSegment* segment, AcuriteDecodeSink& sink );
+
+	// Waits for everything submitted so far and passes it to sink.
+	void Flush( AcuriteDecodeSink& sink );
+
+	// Counts from every segment passed on so far
+	const AcuriteMetrics& GetMetrics() const { return mMetrics; }
+
+protected:
+	void Decode( AcuriteSegment* segment );
+	void Collect( AcuriteDecodeSink& sink, uint64_t until );
+
+	AcuriteDecoderOptions mOptions;
+	uint64_t mMaxInFlight;
+	uint64_t mNextSequence;
+	uint64_t mNextEmit;
+	AcuriteMetrics mMetrics;
+
+	std::mutex mMutex;
+	std::condition_variable mFinishedSignal;
+	std::map< uint64_t, AcuriteSegment* > mFinished; // by mSequence
+
+	std::unique_ptr< AcuriteThreadPool > mPool;
+
+private:
+	AcuriteParallelDecoder( const AcuriteParallelDecoder& );
+	AcuriteParallelDecoder& operator=( const AcuriteParallelDecoder& );
+};
+
+#endif //ACURITE_PARALLEL_DECODER_H
@@ -0,0 +1,52 @@
+#include "AcuritePreambleSeeker.h"
+#include <AnalyzerChannelData.h>
+#include "AcuriteCalibration.h"
+
+AcuritePreambleSeeker::AcuritePreambleSeeker( const AcuriteDecoderOptions& options, bool enabled )
+:	mMinSync( 0 ),
+	mMaxSync( 0 ),
+	mSpan( 0 ),
+	mFeeding( false ),
+	mFeedUntil( 0 ),
+	mSkipped( 0 )
+{
+	if( !enabled )
+		return;
+
+	// Calibration only fits the thresholds later on, to edges this lets through
+	double drift = options.mCalibrationEdges > 0 ? ACURITE_CALIBRATION_MAX_DRIFT : 0;
+	mMinSync = (U32)( options.mTiming.syncWidth * ( 1 - drift ) );
+	if( mMinSync < 1 )
+		mMinSync = 1;
+	mMaxSync = (U32)( options.mTiming.bitWidth * ( 1 + drift ) );
+	mSpan = (U64)( AcuRiteTiming::atLeast( ACURITE_PREAMBLE_SPAN_US, options.mSampleRateHz ) * ( 1 + drift ) );
+}
+
+bool AcuritePreambleSeeker::Keep( AnalyzerChannelData* serial )
+{
+	if( mMinSync == 0 )
+		return true;
+
+	U64 sample = serial->GetSampleNumber();
+	if( serial->GetBitState() == BIT_HIGH )
+	{
+		// Could this pulse be a sync bit? It's high for at least mMinSync, and
+		// falls again within mMaxSync.
+		if( !serial->WouldAdvancingCauseTransition( mMinSync - 1 ) &&
+			serial->WouldAdvancingCauseTransition( mMaxSync ) )
+		{
+			mFeeding = true;
+			mFeedUntil = sample + mSpan;
+		}
+	}
+	else if( mFeeding && sample > mFeedUntil )
+	{
+		// Stop after a falling edge, so the decoder's levels keep alternating
+		mFeeding = false;
+		return true;
+	}
+
+	if( !mFeeding )
+		mSkipped++;
+	return mFeeding;
+}
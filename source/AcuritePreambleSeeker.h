@@ -0,0 +1,48 @@
+#ifndef ACURITE_PREAMBLE_SEEKER_H
+#define ACURITE_PREAMBLE_SEEKER_H
+
+#include <AnalyzerTypes.h>
+#include "AcuriteEdgeDecoder.h"
+
+class AnalyzerChannelData;
+
+// How long a packet can still be going after a sync bit: the rest of the
+// preamble, then 56 bits with both halves as long as a whole bit can be, and
+// the stop bit
+#define ACURITE_PREAMBLE_SPAN_US ( NUM_SYNCS * 2 * MAX_SYNC_WIDTH + 57 * 2 * BIT_WIDTH )
+
+// Picks the edges worth decoding out of a channel. A packet can only start
+// with a sync bit, the one high pulse between syncWidth and bitWidth long
+// (see AcuRiteDecoder), so the channel is read a pulse at a time without
+// decoding anything until a rising edge passes that test (one look-ahead at
+// the SDK's channel data). From there every edge is decoded, up to the first
+// falling edge more than ACURITE_PREAMBLE_SPAN_US after the last such pulse;
+// the decoder still sees alternating levels, with the stretches in between
+// looking like quiet gaps. Idle noise costs reading its edges and nothing else.
+//
+// The SDK can't step back, so the edges are still read one by one: skipping
+// ahead a window at a time would go past the rising edge of the first sync
+// bit, and the decoder needs its exact width.
+class AcuritePreambleSeeker
+{
+public:
+	// Seeks with options' thresholds, allowing for calibration moving them
+	// if it's on; with enabled false every edge is kept.
+	AcuritePreambleSeeker( const AcuriteDecoderOptions& options, bool enabled );
+
+	// serial was just advanced to an edge: true if it's to be decoded.
+	bool Keep( AnalyzerChannelData* serial );
+
+	// Edges read but not decoded
+	U64 GetSkipped() const { return mSkipped; }
+
+protected:
+	U32 mMinSync; // samples; 0: seeking is off
+	U32 mMaxSync;
+	U64 mSpan;
+	bool mFeeding;
+	U64 mFeedUntil;
+	U64 mSkipped;
+};
+
+#endif //ACURITE_PREAMBLE_SEEKER_H
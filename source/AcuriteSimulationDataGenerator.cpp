@@ -1,22 +1,15 @@
 #include <stdlib.h>
 #include "AcuriteSimulationDataGenerator.h"
 #include "AcuriteAnalyzerSettings.h"
+#include "AcuritePacket.h"
+#include "AcuriteSimulationTiming.h"
+#include "AcuriteTrace.h"
 
 #include <AnalyzerHelpers.h>
 
-// Simulation data: 4 sync pulses @ index 0 [662ms on, 564ms off]
-// 56 bits of data: logic 1 [436, 180] or logic 0 [245, 366]
-// one 100ms on-pulse at the end
-#define SYNCHIGH 662
-#define SYNCLOW 564
-#define ONEHIGH 436
-#define ONELOW 180
-#define ZEROHIGH 245
-#define ZEROLOW 366
-#define STOPHIGH 100
-
 AcuriteSimulationDataGenerator::AcuriteSimulationDataGenerator()
-:	mBitCounter( 0 )
+:	mBitCounter( 0 ),
+	mCopyCounter( 0 )
 {
 }
 
@@ -30,27 +23,9 @@ unsigned long RandomLessThan(unsigned long max)
   return ret;
 }
 
-void log2(const char *fmt, ...)
-{
-  va_list args;
-  va_start (args, fmt);
-  char buf[128];
-  vsprintf(buf, fmt, args);
-  va_end(args);
-  
-  FILE *f = fopen("/tmp/debug2.log", "a");
-  fprintf(f, "%s\n", buf);
-  fclose(f);
-}
-
 void SetParity(U8 *b)
 {
-  U8 result = 0;
-  for (char i=0; i<=6; i++) {
-    result ^= ((*b) & (1<<i)) ? 1 : 0;
-  }
-
-  *b |= result ? 0x80 : 0x00;
+  *b |= AcuriteParityBit(*b);
 }
 
 
@@ -103,7 +78,7 @@ void AcuriteSimulationDataGenerator::Initialize( U32 simulation_sample_rate, Acu
   mPacket[6] = cksum;
 
   for (int i=0; i<7; i++) {
-    log2("mPacket[%d] = 0x%.2X", i, mPacket[i]);
+    TRACE(TRACE_PACKET, TRACE_SIM_BYTE, i, mPacket[i], 0);
   }
 }
 
@@ -121,21 +96,32 @@ U32 AcuriteSimulationDataGenerator::GenerateSimulationData( U64 largest_sample_r
   return 1;
 }
 
-void AcuriteSimulationDataGenerator::CreateAcuriteBits()
+// Advance by a duration in uS, converted at the exact simulation rate (no
+// truncation to whole samples per uS), in chunks Advance() can take.
+void AcuriteSimulationDataGenerator::AdvanceUs( U64 us )
 {
-  U32 samples_per_ms = mSimulationSampleRateHz / 1000000;
+  U64 samples = us * mSimulationSampleRateHz / 1000000;
 
-  if (mBitCounter == 0) {
+  while (samples > 0xFFFFFFFF) {
+    mSerialSimulationData.Advance( 0xFFFFFFFF );
+    samples -= 0xFFFFFFFF;
+  }
+  mSerialSimulationData.Advance( (U32)samples );
+}
+
+void AcuriteSimulationDataGenerator::CreateAcuriteBits()
+{
+  if (mBitCounter == 0 && mCopyCounter == 0) {
     // Lead-in time...
-    mSerialSimulationData.Advance( samples_per_ms * 100000);
+    AdvanceUs( 100000 );
   }
   
   if (mBitCounter < 4) {
     // sync pulse, please
     mSerialSimulationData.Transition(); // go high
-    mSerialSimulationData.Advance( samples_per_ms * SYNCHIGH );
+    AdvanceUs( SYNCHIGH );
     mSerialSimulationData.Transition(); // back low
-    mSerialSimulationData.Advance( samples_per_ms * SYNCLOW );
+    AdvanceUs( SYNCLOW );
   } else if (mBitCounter < 56 + 4) {
 
     // mid-bitstream; figure out our byte index and then the bit in it
@@ -146,22 +132,28 @@ void AcuriteSimulationDataGenerator::CreateAcuriteBits()
     if (bitOn) {
       // 1-bit
       mSerialSimulationData.Transition(); // go high
-      mSerialSimulationData.Advance( samples_per_ms * ONEHIGH );
+      AdvanceUs( ONEHIGH );
       mSerialSimulationData.Transition(); // back low
-      mSerialSimulationData.Advance( samples_per_ms * ONELOW );
+      AdvanceUs( ONELOW );
     } else {
       // 0-bit
       mSerialSimulationData.Transition(); // go high
-      mSerialSimulationData.Advance( samples_per_ms * ZEROHIGH );
+      AdvanceUs( ZEROHIGH );
       mSerialSimulationData.Transition(); // back low
-      mSerialSimulationData.Advance( samples_per_ms * ZEROLOW );
+      AdvanceUs( ZEROLOW );
     }
   } else {
     // final half-bit
     mSerialSimulationData.Transition(); // go high
-    mSerialSimulationData.Advance( samples_per_ms * STOPHIGH );
+    AdvanceUs( STOPHIGH );
     mSerialSimulationData.Transition(); // back low
-    mSerialSimulationData.Advance( samples_per_ms * 30000000 );
+    if (++mCopyCounter < SIM_COPIES) {
+      // the next copy follows right away
+      AdvanceUs( SYNCLOW );
+    } else {
+      AdvanceUs( 30000000 );
+      mCopyCounter = 0;
+    }
     mBitCounter = -1;
   }
 
@@ -20,7 +20,9 @@ protected:
 
 protected:
 	void CreateAcuriteBits();
+	void AdvanceUs( U64 us );
 	U32 mBitCounter;
+	U32 mCopyCounter; // which copy of the packet in this burst
 
 	SimulationChannelDescriptor mSerialSimulationData;
 
@@ -0,0 +1,19 @@
+#ifndef ACURITE_SIMULATION_TIMING_H
+#define ACURITE_SIMULATION_TIMING_H
+
+// What an AcuRite sensor transmits, for the simulation data generator and
+// the benchmark (tools/AcuriteBench.cpp), in uS:
+// 4 sync pulses @ index 0 [662 on, 564 off]
+// 56 bits of data: logic 1 [436, 180] or logic 0 [245, 366]
+// one 100 on-pulse at the end
+// sent SIM_COPIES times per burst, like the real sensors do
+#define SYNCHIGH 662
+#define SYNCLOW 564
+#define ONEHIGH 436
+#define ONELOW 180
+#define ZEROHIGH 245
+#define ZEROLOW 366
+#define STOPHIGH 100
+#define SIM_COPIES 3
+
+#endif //ACURITE_SIMULATION_TIMING_H
@@ -0,0 +1,83 @@
+#include "AcuriteThreadPool.h"
+
+AcuriteThreadPool::AcuriteThreadPool( unsigned threads )
+:	mNextWorker( 0 ),
+	mUnclaimed( 0 ),
+	mStopping( false )
+{
+	if( threads == 0 )
+		threads = 1;
+
+	for( unsigned i = 0; i < threads; i++ )
+		mWorkers.push_back( std::unique_ptr< Worker >( new Worker() ) );
+	for( unsigned i = 0; i < threads; i++ )
+		mWorkers[ i ]->mThread = std::thread( &AcuriteThreadPool::Run, this, i );
+}
+
+AcuriteThreadPool::~AcuriteThreadPool()
+{
+	{
+		std::lock_guard< std::mutex > lock( mWakeMutex );
+		mStopping = true;
+	}
+	mWake.notify_all();
+
+	for( unsigned i = 0; i < mWorkers.size(); i++ )
+		mWorkers[ i ]->mThread.join();
+}
+
+void AcuriteThreadPool::Submit( const Task& task )
+{
+	Worker& worker = *mWorkers[ mNextWorker++ % mWorkers.size() ];
+	{
+		std::lock_guard< std::mutex > lock( worker.mMutex );
+		worker.mTasks.push_back( task );
+	}
+
+	// Only announce the task once it's findable, so a worker that claims it
+	// is guaranteed to find something in one of the deques.
+	{
+		std::lock_guard< std::mutex > lock( mWakeMutex );
+		mUnclaimed++;
+	}
+	mWake.notify_one();
+}
+
+// Oldest task from our own deque, else steal the oldest from someone else's.
+bool AcuriteThreadPool::Take( unsigned self, Task& task )
+{
+	for( unsigned i = 0; i < mWorkers.size(); i++ )
+	{
+		Worker& worker = *mWorkers[ ( self + i ) % mWorkers.size() ];
+		std::lock_guard< std::mutex > lock( worker.mMutex );
+		if( !worker.mTasks.empty() )
+		{
+			task.swap( worker.mTasks.front() );
+			worker.mTasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void AcuriteThreadPool::Run( unsigned self )
+{
+	for( ;; )
+	{
+		{
+			std::unique_lock< std::mutex > lock( mWakeMutex );
+			while( mUnclaimed == 0 && !mStopping )
+				mWake.wait( lock );
+			if( mUnclaimed == 0 )
+				return;
+			mUnclaimed--;
+		}
+
+		// One task is ours; another claimant may grab the copy we look at
+		// first, but there are at least as many tasks as claims.
+		Task task;
+		while( !Take( self, task ) )
+			std::this_thread::yield();
+		task();
+	}
+}
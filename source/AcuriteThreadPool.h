@@ -0,0 +1,52 @@
+#ifndef ACURITE_THREAD_POOL_H
+#define ACURITE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. Submitted tasks
+// are dealt out round robin; a worker whose deque runs dry steals from the
+// others, so uneven tasks still keep every thread busy.
+class AcuriteThreadPool
+{
+public:
+	typedef std::function< void () > Task;
+
+	AcuriteThreadPool( unsigned threads );
+	// Runs whatever is still queued, then joins the workers.
+	~AcuriteThreadPool();
+
+	void Submit( const Task& task );
+	unsigned GetThreadCount() const { return (unsigned)mWorkers.size(); }
+
+protected:
+	struct Worker
+	{
+		std::mutex mMutex;
+		std::deque< Task > mTasks;
+		std::thread mThread;
+	};
+
+	void Run( unsigned self );
+	bool Take( unsigned self, Task& task );
+
+	std::vector< std::unique_ptr< Worker > > mWorkers;
+	unsigned mNextWorker;
+
+	// Number of queued tasks not yet claimed by a worker
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+	unsigned mUnclaimed;
+	bool mStopping;
+
+private:
+	AcuriteThreadPool( const AcuriteThreadPool& );
+	AcuriteThreadPool& operator=( const AcuriteThreadPool& );
+};
+
+#endif //ACURITE_THREAD_POOL_H
@@ -0,0 +1,170 @@
+#include "AcuriteTrace.h"
+
+#if ACURITE_TRACE_LEVEL > TRACE_OFF
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Bounded multi-producer ring (one sequence number per cell), drained by a
+// single consumer thread. Size must be a power of two.
+#define TRACE_RING_SIZE ( 1 << 16 )
+#define TRACE_DRAIN_INTERVAL_MS 50
+
+namespace
+{
+	struct TraceCell
+	{
+		std::atomic<uint64_t> mSequence;
+		AcuriteTraceRecord mRecord;
+	};
+
+	TraceCell gRing[ TRACE_RING_SIZE ];
+	std::atomic<uint64_t> gEnqueuePos( 0 );
+	uint64_t gDequeuePos = 0; // consumer only
+	std::atomic<uint64_t> gDropped( 0 );
+	std::atomic<uint32_t> gNextThread( 0 );
+
+	std::mutex gLifetimeMutex;
+	std::condition_variable gWake;
+	std::thread gConsumer;
+	int gUsers = 0;
+	bool gStopping = false;
+
+	struct TraceRingInit
+	{
+		TraceRingInit()
+		{
+			for( uint64_t i = 0; i < TRACE_RING_SIZE; i++ )
+				gRing[ i ].mSequence.store( i, std::memory_order_relaxed );
+		}
+	} gRingInit;
+
+	uint32_t ThreadTag()
+	{
+		static thread_local uint32_t tag = gNextThread.fetch_add( 1 ) + 1;
+		return tag;
+	}
+
+	// Consumer side: copy out every published record, in order.
+	void Drain( FILE* f )
+	{
+		uint64_t dropped = gDropped.exchange( 0, std::memory_order_relaxed );
+		if( dropped && f )
+		{
+			AcuriteTraceRecord r = { 0, dropped, TRACE_DROPPED, 0, 0, 0 };
+			fwrite( &r, sizeof r, 1, f );
+		}
+
+		for( ;; )
+		{
+			TraceCell& cell = gRing[ gDequeuePos & ( TRACE_RING_SIZE - 1 ) ];
+			if( cell.mSequence.load( std::memory_order_acquire ) != gDequeuePos + 1 )
+				break;
+
+			if( f )
+				fwrite( &cell.mRecord, sizeof cell.mRecord, 1, f );
+			cell.mSequence.store( gDequeuePos + TRACE_RING_SIZE, std::memory_order_release );
+			gDequeuePos++;
+		}
+
+		if( f )
+			fflush( f );
+	}
+
+	void ConsumerThread()
+	{
+		FILE* f = fopen( ACURITE_TRACE_FILE, "ab" );
+
+		std::unique_lock<std::mutex> lock( gLifetimeMutex );
+		while( !gStopping )
+		{
+			gWake.wait_for( lock, std::chrono::milliseconds( TRACE_DRAIN_INTERVAL_MS ) );
+			lock.unlock();
+			Drain( f );
+			lock.lock();
+		}
+		lock.unlock();
+
+		Drain( f );
+		if( f )
+			fclose( f );
+	}
+}
+
+void AcuriteTraceStart()
+{
+	std::lock_guard<std::mutex> lock( gLifetimeMutex );
+	if( gUsers++ == 0 )
+	{
+		gStopping = false;
+		gConsumer = std::thread( ConsumerThread );
+	}
+}
+
+void AcuriteTraceStop()
+{
+	std::thread consumer;
+	{
+		std::lock_guard<std::mutex> lock( gLifetimeMutex );
+		if( gUsers == 0 || --gUsers > 0 )
+			return;
+		gStopping = true;
+		consumer.swap( gConsumer );
+	}
+	gWake.notify_all();
+	consumer.join();
+}
+
+void AcuriteTraceWrite( uint16_t event, uint64_t sample, uint64_t width, uint8_t state )
+{
+	uint64_t pos = gEnqueuePos.load( std::memory_order_relaxed );
+	TraceCell* cell;
+	for( ;; )
+	{
+		cell = &gRing[ pos & ( TRACE_RING_SIZE - 1 ) ];
+		int64_t diff = (int64_t)cell->mSequence.load( std::memory_order_acquire ) - (int64_t)pos;
+		if( diff == 0 )
+		{
+			if( gEnqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+				break;
+		}
+		else if( diff < 0 )
+		{
+			// Ring is full; the consumer hasn't caught up.
+			gDropped.fetch_add( 1, std::memory_order_relaxed );
+			return;
+		}
+		else
+		{
+			pos = gEnqueuePos.load( std::memory_order_relaxed );
+		}
+	}
+
+	cell->mRecord.mSample = sample;
+	cell->mRecord.mWidth = width;
+	cell->mRecord.mEvent = event;
+	cell->mRecord.mState = state;
+	cell->mRecord.mReserved = 0;
+	cell->mRecord.mThread = ThreadTag();
+	cell->mSequence.store( pos + 1, std::memory_order_release );
+}
+
+#else
+
+void AcuriteTraceStart()
+{
+}
+
+void AcuriteTraceStop()
+{
+}
+
+void AcuriteTraceWrite( uint16_t event, uint64_t sample, uint64_t width, uint8_t state )
+{
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ACURITE_TRACE_H
+#define ACURITE_TRACE_H
+
+// Binary tracing for the decoder. Records go into a preallocated lock-free
+// ring; a background consumer drains the ring to ACURITE_TRACE_FILE.
+//
+// ACURITE_TRACE_LEVEL picks what is compiled in. Release builds leave it at
+// TRACE_OFF, which turns every TRACE() into nothing (arguments included).
+
+#include <stdint.h>
+
+#define TRACE_OFF    0
+#define TRACE_PACKET 1 // a handful of records per packet
+#define TRACE_EDGE   2 // one record per edge
+
+#ifndef ACURITE_TRACE_LEVEL
+#define ACURITE_TRACE_LEVEL TRACE_OFF
+#endif
+
+#ifndef ACURITE_TRACE_FILE
+#define ACURITE_TRACE_FILE "/tmp/acurite-trace.bin"
+#endif
+
+enum AcuriteTraceEvent {
+	TRACE_SAMPLE_RATE = 1, // sample = sample rate in Hz
+	TRACE_PULSE,           // sample, width = pulse handed to the decoder, state = decoder state afterwards
+	TRACE_PACKET_DONE,     // sample = edge that completed the packet
+	TRACE_SIM_BYTE,        // sample = byte index, width = byte value (simulator)
+	TRACE_DROPPED,         // width = records lost to a full ring since the last drain
+	TRACE_RESYNC,          // sample = where a resync restarted the frame, width = pulses replayed, state = 1 if that made a packet
+	TRACE_CORRECTED        // sample = edge that completed the packet, width = the bit flipped to make it valid
+};
+
+// One ring entry, written to the trace file as-is (host byte order).
+struct AcuriteTraceRecord
+{
+	uint64_t mSample;
+	uint64_t mWidth;
+	uint16_t mEvent;
+	uint8_t mState;
+	uint8_t mReserved;
+	uint32_t mThread;
+};
+
+// Reference counted: the first Start() launches the consumer thread, the
+// last Stop() drains whatever is left and joins it.
+void AcuriteTraceStart();
+void AcuriteTraceStop();
+
+// Producer side; safe from any thread. Drops (and counts) the record if the
+// ring is full rather than blocking the caller.
+void AcuriteTraceWrite( uint16_t event, uint64_t sample, uint64_t width, uint8_t state );
+
+#if ACURITE_TRACE_LEVEL > TRACE_OFF
+#define TRACE( level, event, sample, width, state ) \
+	do { if( ( level ) <= ACURITE_TRACE_LEVEL ) AcuriteTraceWrite( ( event ), ( sample ), ( width ), ( state ) ); } while( 0 )
+#else
+#define TRACE( level, event, sample, width, state ) do { } while( 0 )
+#endif
+
+#endif //ACURITE_TRACE_H
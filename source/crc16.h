@@ -2,6 +2,7 @@
 #define _UTIL_CRC16_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 static inline uint16_t _crc16_update(uint16_t crc, uint8_t data) __attribute__((always_inline, unused));
 static inline uint16_t _crc16_update(uint16_t crc, uint8_t data)
@@ -61,5 +62,152 @@ static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
 	return crc;
 }
 
-#endif
+/*
+ * Buffer-level versions of the functions above. Each one gives the same
+ * result as folding the matching _crc*_update() over data[0..len) starting
+ * from crc, but eats 8 bytes per step through slicing-by-8 tables (then 4,
+ * then 1). The tables are computed by the compiler from the bit-serial
+ * definitions, expanded 256 entries at a time by the preprocessor.
+ */
+
+/* one byte through a bit-serial CRC register */
+static constexpr uint16_t _crc_lsb_bits(uint16_t crc, uint16_t poly, int n)
+{
+	return n == 0 ? crc : _crc_lsb_bits((crc & 1) ? (crc >> 1) ^ poly : (crc >> 1), poly, n - 1);
+}
+
+static constexpr uint16_t _crc_msb_bits(uint16_t crc, uint16_t poly, int n)
+{
+	return n == 0 ? crc : _crc_msb_bits((crc & 0x8000) ? (uint16_t)((crc << 1) ^ poly) : (uint16_t)(crc << 1), poly, n - 1);
+}
+
+#define _CRC_T4(f, k, n)   f(k, n), f(k, n + 1), f(k, n + 2), f(k, n + 3)
+#define _CRC_T16(f, k, n)  _CRC_T4(f, k, n), _CRC_T4(f, k, n + 4), _CRC_T4(f, k, n + 8), _CRC_T4(f, k, n + 12)
+#define _CRC_T64(f, k, n)  _CRC_T16(f, k, n), _CRC_T16(f, k, n + 16), _CRC_T16(f, k, n + 32), _CRC_T16(f, k, n + 48)
+#define _CRC_T256(f, k)    { _CRC_T64(f, k, 0), _CRC_T64(f, k, 64), _CRC_T64(f, k, 128), _CRC_T64(f, k, 192) }
+#define _CRC_TABLES(f)     { _CRC_T256(f, 0), _CRC_T256(f, 1), _CRC_T256(f, 2), _CRC_T256(f, 3), \
+                             _CRC_T256(f, 4), _CRC_T256(f, 5), _CRC_T256(f, 6), _CRC_T256(f, 7) }
+
+/* the classic one-byte tables, bit-serially */
+#define _CRC16_BYTE(k, i)       _crc_lsb_bits(i, 0xA001, 8)
+#define _CRC_XMODEM_BYTE(k, i)  _crc_msb_bits((i) << 8, 0x1021, 8)
+#define _CRC_CCITT_BYTE(k, i)   _crc_lsb_bits(i, 0x8408, 8)
+#define _CRC_IBUTTON_BYTE(k, i) (uint8_t)_crc_lsb_bits(i, 0x8C, 8)
+
+static constexpr uint16_t _crc16_byte[256] = _CRC_T256(_CRC16_BYTE, 0);
+static constexpr uint16_t _crc_xmodem_byte[256] = _CRC_T256(_CRC_XMODEM_BYTE, 0);
+static constexpr uint16_t _crc_ccitt_byte[256] = _CRC_T256(_CRC_CCITT_BYTE, 0);
+static constexpr uint8_t _crc_ibutton_byte[256] = _CRC_T256(_CRC_IBUTTON_BYTE, 0);
+
+/* slice k, entry i: byte i followed by k zero bytes, each zero byte one lookup */
+static constexpr uint16_t _crc_lsb_zeros(const uint16_t *t, int k, uint16_t crc)
+{
+	return k == 0 ? crc : _crc_lsb_zeros(t, k - 1, (crc >> 8) ^ t[crc & 0xFF]);
+}
 
+static constexpr uint16_t _crc_msb_zeros(const uint16_t *t, int k, uint16_t crc)
+{
+	return k == 0 ? crc : _crc_msb_zeros(t, k - 1, (uint16_t)(crc << 8) ^ t[crc >> 8]);
+}
+
+static constexpr uint8_t _crc_ibutton_zeros(int k, uint8_t crc)
+{
+	return k == 0 ? crc : _crc_ibutton_zeros(k - 1, _crc_ibutton_byte[crc]);
+}
+
+#define _CRC16_ENTRY(k, i)       _crc_lsb_zeros(_crc16_byte, k, _crc16_byte[i])
+#define _CRC_XMODEM_ENTRY(k, i)  _crc_msb_zeros(_crc_xmodem_byte, k, _crc_xmodem_byte[i])
+#define _CRC_CCITT_ENTRY(k, i)   _crc_lsb_zeros(_crc_ccitt_byte, k, _crc_ccitt_byte[i])
+#define _CRC_IBUTTON_ENTRY(k, i) _crc_ibutton_zeros(k, _crc_ibutton_byte[i])
+
+static constexpr uint16_t _crc16_table[8][256] = _CRC_TABLES(_CRC16_ENTRY);
+static constexpr uint16_t _crc_xmodem_table[8][256] = _CRC_TABLES(_CRC_XMODEM_ENTRY);
+static constexpr uint16_t _crc_ccitt_table[8][256] = _CRC_TABLES(_CRC_CCITT_ENTRY);
+static constexpr uint8_t _crc_ibutton_table[8][256] = _CRC_TABLES(_CRC_IBUTTON_ENTRY);
+
+#undef _CRC_T4
+#undef _CRC_T16
+#undef _CRC_T64
+#undef _CRC_T256
+#undef _CRC_TABLES
+#undef _CRC16_BYTE
+#undef _CRC_XMODEM_BYTE
+#undef _CRC_CCITT_BYTE
+#undef _CRC_IBUTTON_BYTE
+#undef _CRC16_ENTRY
+#undef _CRC_XMODEM_ENTRY
+#undef _CRC_CCITT_ENTRY
+#undef _CRC_IBUTTON_ENTRY
+
+/* LSB-first 16-bit CRCs (crc16, ccitt): the register overlays the first two bytes */
+static inline uint16_t _crc_lsb16(const uint16_t (*t)[256], uint16_t crc, const uint8_t *data, size_t len)
+{
+	for (; len >= 8; data += 8, len -= 8) {
+		crc = t[7][data[0] ^ (crc & 0xFF)] ^ t[6][data[1] ^ (crc >> 8)] ^
+			t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+			t[1][data[6]] ^ t[0][data[7]];
+	}
+	if (len >= 4) {
+		crc = t[3][data[0] ^ (crc & 0xFF)] ^ t[2][data[1] ^ (crc >> 8)] ^
+			t[1][data[2]] ^ t[0][data[3]];
+		data += 4;
+		len -= 4;
+	}
+	while (len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+	return crc;
+}
+
+static inline uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) __attribute__((unused));
+static inline uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+	return _crc_lsb16(_crc16_table, crc, data, len);
+}
+
+static inline uint16_t crc_ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) __attribute__((unused));
+static inline uint16_t crc_ccitt(const uint8_t *data, size_t len, uint16_t crc)
+{
+	return _crc_lsb16(_crc_ccitt_table, crc, data, len);
+}
+
+static inline uint16_t crc_xmodem(const uint8_t *data, size_t len, uint16_t crc = 0) __attribute__((unused));
+static inline uint16_t crc_xmodem(const uint8_t *data, size_t len, uint16_t crc)
+{
+	const uint16_t (*t)[256] = _crc_xmodem_table;
+
+	for (; len >= 8; data += 8, len -= 8) {
+		crc = t[7][data[0] ^ (crc >> 8)] ^ t[6][data[1] ^ (crc & 0xFF)] ^
+			t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+			t[1][data[6]] ^ t[0][data[7]];
+	}
+	if (len >= 4) {
+		crc = t[3][data[0] ^ (crc >> 8)] ^ t[2][data[1] ^ (crc & 0xFF)] ^
+			t[1][data[2]] ^ t[0][data[3]];
+		data += 4;
+		len -= 4;
+	}
+	while (len--)
+		crc = (uint16_t)(crc << 8) ^ t[0][(crc >> 8) ^ *data++];
+	return crc;
+}
+
+static inline uint8_t crc_ibutton(const uint8_t *data, size_t len, uint8_t crc = 0) __attribute__((unused));
+static inline uint8_t crc_ibutton(const uint8_t *data, size_t len, uint8_t crc)
+{
+	const uint8_t (*t)[256] = _crc_ibutton_table;
+
+	for (; len >= 8; data += 8, len -= 8) {
+		crc = t[7][data[0] ^ crc] ^ t[6][data[1]] ^ t[5][data[2]] ^ t[4][data[3]] ^
+			t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	if (len >= 4) {
+		crc = t[3][data[0] ^ crc] ^ t[2][data[1]] ^ t[1][data[2]] ^ t[0][data[3]];
+		data += 4;
+		len -= 4;
+	}
+	while (len--)
+		crc = t[0][crc ^ *data++];
+	return crc;
+}
+
+#endif
@@ -4,23 +4,43 @@
 // Modified 2015-03-04 <jorj@jorj.org>, adding AcuRite temp sensor demod
 //   ... made a little dumber for Saleae Logic embedded use
 
+#ifndef ACURITE_DECODERS_H
+#define ACURITE_DECODERS_H
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "crc16.h"
 #include "glue.h"
 
-class DecodeOOK {
+// byte-wise bit reversal table, built by the preprocessor
+#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n) R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+static const byte reversedByte[256] = { R6(0), R6(2), R6(1), R6(3) };
+#undef R2
+#undef R4
+#undef R6
+
+// Decoder states, shared by every decoder
+struct OOKStates {
+    enum { UNKNOWN, T0, T1, T2, T3, OK, DONE };
+};
+
+// Packet assembly and pulse dispatch common to all decoders. Derived supplies
+// 'char decode (word width)', which nextPulse() calls without a virtual call,
+// so a concrete decoder's whole per-edge step can inline into its caller.
+template <class Derived>
+class OOKDecoder : public OOKStates {
  public:
   //protected:
     byte bits, flip, state, pos, data[25];
+    // shift register for shiftBit(); holds a whole AcuRite packet
+    uint64_t acc;
     // the following fields are used to deal with duplicate packets
     word lastCrc, lastTime;
     byte repeats, minGap, minCount;
 
-    // gets called once per incoming pulse with the width in us
-    // return values: 0 = keep going, 1 = done, -1 = no match
-    virtual char decode (word width) =0;
-    
     // add one bit to the packet data buffer
     void gotBit (char value) {
         byte *ptr = data + pos;
@@ -37,6 +57,46 @@ class DecodeOOK {
         state = OK;
     }
     
+    // add one bit to the 64-bit shift register instead of data[]; bits keep
+    // their arrival order, first bit most significant, and only reach data[]
+    // through flushBits(). bits/pos count exactly as they do for gotBit().
+    void shiftBit (char value) {
+        if (pos >= sizeof acc) {
+            resetDecoder();
+            return;
+        }
+        acc = (acc << 1) | (value & 1);
+
+        if (++bits >= 8) {
+            bits = 0;
+            ++pos;
+        }
+
+        state = OK;
+    }
+
+    // copy the shift register out to data[] with the first bit in the MSB of
+    // data[0] -- the bytes gotBit() + reverseBits() would have produced. A
+    // partial last byte is zero padded and counted.
+    void flushBits () {
+        if (bits) {
+            acc <<= 8 - bits;
+            bits = 0;
+            ++pos;
+        }
+        if (!pos)
+            return;
+
+        uint64_t v = acc << (64 - 8 * pos);
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        v = __builtin_bswap64(v);
+        memcpy(data, &v, pos);
+#else
+        for (byte i = 0; i < pos; ++i)
+            data[i] = (byte) (v >> (56 - 8 * i));
+#endif
+    }
+
     // store a bit using Manchester encoding
     void manchester (char value) {
         flip ^= value; // manchester code, long pulse flips the bit
@@ -62,30 +122,47 @@ class DecodeOOK {
     }
     
     void reverseBits () {
-        for (byte i = 0; i < pos; ++i) {
-            byte b = data[i];
-            for (byte j = 0; j < 8; ++j) {
-                data[i] = (data[i] << 1) | (b & 1);
-                b >>= 1;
-            }
-        }
+        for (byte i = 0; i < pos; ++i)
+            data[i] = reversedByte[data[i]];
     }
     
     void reverseNibbles () {
         for (byte i = 0; i < pos; ++i)
             data[i] = (data[i] << 4) | (data[i] >> 4);
     }
+
+    // is the packet in data[] another copy of the last one checked? Copies
+    // must match and start no more than 'window' after the previous copy
+    // ended; times are in whatever units the caller likes. Counts repeats.
+    bool checkRepeats (word start, word end, word window) {
+        // calculate the checksum over the current packet
+        word crc = crc16(data, pos, 0xFFFF);
+        // if different crc or too long ago, this cannot be a repeated packet
+        bool repeat = repeats > 0 && repeats < 255 && crc == lastCrc &&
+                      start - lastTime <= window;
+        if (!repeat)
+            repeats = 0;
+        // save last values
+        lastCrc = crc;
+        lastTime = end;
+        ++repeats;
+        return repeat;
+    }
+
+    // forget the last packet checked, so the next one can't be a repeat
+    void resetRepeats () {
+        lastCrc = lastTime = 0;
+        repeats = 0;
+    }
     
 public:
-    enum { UNKNOWN, T0, T1, T2, T3, OK, DONE };
-
-    DecodeOOK (byte gap =5, byte count =0) 
+    OOKDecoder (byte gap =5, byte count =0) 
         : lastCrc (0), lastTime (0), repeats (0), minGap (gap), minCount (count)
         { resetDecoder(); }
         
     bool nextPulse (word width) {
         if (state != DONE)
-            switch (decode(width)) {
+            switch (static_cast<Derived*>(this)->decode(width)) {
                 case -1: // decoding failed
                     resetDecoder();
                     break;
@@ -105,10 +182,22 @@ public:
     
     void resetDecoder () {
         bits = pos = flip = 0;
+        acc = 0;
         state = UNKNOWN;
     }
 };
 
+// Run-time polymorphic decoder, for code that picks decoders dynamically
+class DecodeOOK : public OOKDecoder<DecodeOOK> {
+ public:
+    DecodeOOK (byte gap =5, byte count =0) : OOKDecoder<DecodeOOK> (gap, count) {}
+
+    // gets called once per incoming pulse with the width in the decoder's
+    // time base (raw samples for AcuRiteDecoder, see AcuRiteTiming)
+    // return values: 0 = keep going, 1 = done, -1 = no match
+    virtual char decode (word width) =0;
+};
+
 // 433 MHz decoders
 
 #define SYNC_WIDTH 500 // min duration of the positive half of a sync bit (uS)
@@ -117,94 +206,224 @@ public:
 #define ZERO_WIDTH 190
 #define BIT_WIDTH 1200 // total duration of a one-bit pulse
 #define NUM_SYNCS 4
+// A data bit's halves as a sensor sends them (uS), for judging the signal;
+// the simulator sends the same (see AcuriteSimulationTiming.h)
+#define ZERO_HIGH 245
+#define ZERO_LOW 366
+#define ONE_HIGH 436
+#define ONE_LOW 180
+
+// The widths above converted from uS to raw sample counts, once per capture,
+// so the per-edge path compares sample deltas without dividing. ">=" limits
+// round up and ">" limits round down, which makes a sample count pass exactly
+// when its true duration in uS would, at any sample rate. The nominal halves
+// are rounded to the nearest sample.
+struct AcuRiteTiming {
+  word syncWidth, maxSyncWidth, oneWidth, zeroWidth, bitWidth;
+  // a 0 bit's halves, then a 1 bit's, as sent
+  word nominalHigh[2], nominalLow[2];
 
-class AcuRiteDecoder : public DecodeOOK {
+  AcuRiteTiming (unsigned long sampleRateHz =1000000) {
+    setSampleRate(sampleRateHz);
+  }
+
+  void setSampleRate (unsigned long sampleRateHz) {
+    syncWidth = atLeast(SYNC_WIDTH, sampleRateHz);
+    maxSyncWidth = atMost(MAX_SYNC_WIDTH, sampleRateHz);
+    oneWidth = atLeast(ONE_WIDTH, sampleRateHz);
+    zeroWidth = atLeast(ZERO_WIDTH, sampleRateHz);
+    bitWidth = atMost(BIT_WIDTH, sampleRateHz);
+    nominalHigh[0] = nearest(ZERO_HIGH, sampleRateHz);
+    nominalHigh[1] = nearest(ONE_HIGH, sampleRateHz);
+    nominalLow[0] = nearest(ZERO_LOW, sampleRateHz);
+    nominalLow[1] = nearest(ONE_LOW, sampleRateHz);
+  }
+
+  static word atLeast (unsigned long us, unsigned long sampleRateHz) {
+    return (word) (((unsigned long long) us * sampleRateHz + 999999) / 1000000);
+  }
+
+  static word atMost (unsigned long us, unsigned long sampleRateHz) {
+    return (word) (((unsigned long long) us * sampleRateHz) / 1000000);
+  }
+
+  static word nearest (unsigned long us, unsigned long sampleRateHz) {
+    return (word) (((unsigned long long) us * sampleRateHz + 500000) / 1000000);
+  }
+};
+
+// AcuRite pulse-width classes, from the per-capture thresholds
+enum {
+  ACURITE_W_NONE,      // zero width
+  ACURITE_W_SHORT,     // < zeroWidth
+  ACURITE_W_ZERO,      // [zeroWidth, oneWidth)
+  ACURITE_W_ONE,       // [oneWidth, syncWidth)
+  ACURITE_W_SYNC,      // [syncWidth, maxSyncWidth]
+  ACURITE_W_LONGSYNC,  // (maxSyncWidth, bitWidth]
+  ACURITE_W_LONG,      // > bitWidth
+  ACURITE_NUM_WIDTHS
+};
+
+// What AcuRiteDecoder does with a pulse, given its state and width class.
+// The state that follows comes with the action, not from the table, so the
+// next pulse's lookup doesn't wait on this one's. A data bit's value is the
+// action's low bit, and both values take the same branch: the decoder
+// doesn't branch on the data.
+enum {
+  ACURITE_FAIL,        // no match; return -1
+  ACURITE_STAY,        // ignore the pulse
+  ACURITE_TO_OK,       // move to OK
+  ACURITE_TO_T0,       // move to T0: the positive half of a sync bit
+  ACURITE_SYNC_DATA0,  // count a sync bit, then as ACURITE_DATA0 (a missed transition)
+  ACURITE_SYNC_DATA1,  // ... then as ACURITE_DATA1
+  ACURITE_DATA0,       // positive half of a 0 bit: T2 if all syncs seen, else T3
+  ACURITE_DATA1,       // positive half of a 1 bit: T1 if all syncs seen, else T3
+  ACURITE_BIT0,        // store a 0 bit, move to OK
+  ACURITE_BIT1,        // store a 1 bit, move to OK
+  ACURITE_SYNC         // count a sync bit, move to OK
+};
+
+#define F   ACURITE_FAIL
+#define S   ACURITE_STAY
+#define GOK ACURITE_TO_OK
+#define GT0 ACURITE_TO_T0
+#define SY  ACURITE_SYNC
+#define SD0 ACURITE_SYNC_DATA0
+#define SD1 ACURITE_SYNC_DATA1
+#define D0  ACURITE_DATA0
+#define D1  ACURITE_DATA1
+#define B0  ACURITE_BIT0
+#define B1  ACURITE_BIT1
+
+static constexpr byte acuRiteActions[OOKStates::DONE][ACURITE_NUM_WIDTHS] = {
+  //  NONE SHORT ZERO ONE  SYNC LONGSYNC LONG
+  {   F,   GOK,  GOK, GOK, GOK, GOK,    GOK }, // UNKNOWN: 0-to-positive initial transition
+  {   F,   SY,   SD0, SD1, SY,  F,      F   }, // T0: sync; short means a missed transition
+  {   F,   B1,   B1,  B1,  B1,  B1,     B1  }, // T1: zero-pulse of a 1-bit
+  {   F,   B0,   B0,  B0,  B0,  B0,     B0  }, // T2: zero-pulse of a 0-bit
+  {   F,   F,    F,   F,   F,   F,      F   }, // T3: error; consume the 0-bit and reset
+  {   F,   S,    D0,  D1,  GT0, GT0,    F   }, // OK: positive half says SYNC/0/1
+};
+
+#undef F
+#undef S
+#undef GOK
+#undef GT0
+#undef SY
+#undef SD0
+#undef SD1
+#undef D0
+#undef D1
+#undef B0
+#undef B1
+
+// Table driven and statically dispatched (see OOKDecoder), so nextPulse()
+// inlines into the edge loop.
+class AcuRiteDecoder : public OOKDecoder<AcuRiteDecoder> {
  public:
-  AcuRiteDecoder () {}
+  AcuRiteTiming timing;
+  // sync bits a packet may start after; NUM_SYNCS unless resyncing on the
+  // guess that the first one went missing
+  byte minSyncs;
+  // how far the positive half of each data bit so far, in arrival order,
+  // was from oneWidth; the closest are the likeliest to have been misread
+  // (see AcuriteCorrectPacket). Data bits are all under syncWidth, so 32
+  // bits is plenty.
+  uint32_t margins[56];
+  // the signal, over the data bits so far (see AcuritePacket), in samples:
+  // how far their halves were off the nominal widths, summed and at worst,
+  // and the least room a positive half had left in its class
+  uint64_t deviationSum;
+  word maxDeviation, minMargin;
 
-  virtual char decode (word width) {
-    char ret = 0;
+  AcuRiteDecoder () : minSyncs(NUM_SYNCS), deviationSum(0), maxDeviation(0), minMargin(0) {}
 
-    if (!width)
-      return -1;
+  void setSampleRate (unsigned long sampleRateHz) {
+    timing.setSampleRate(sampleRateHz);
+  }
+
+  // branch free: one compare per threshold, summed
+  byte classify (word width) const {
+    byte c = 1 + (width >= timing.zeroWidth) + (width >= timing.oneWidth) +
+      (width >= timing.syncWidth) + (width > timing.maxSyncWidth) +
+      (width > timing.bitWidth);
+    return width ? c : (byte) ACURITE_W_NONE;
+  }
+
+  // one half of a data bit, width off from nominal
+  void deviate (word width, word nominal) {
+    word off = width > nominal ? width - nominal : nominal - width;
+    deviationSum += off;
+    if (off > maxDeviation)
+      maxDeviation = off;
+  }
 
-    switch (state) {
-    case UNKNOWN:
-      // 0-to-positive initial transition
+  // the positive half of a data bit
+  void dataBit (word width, int one) {
+    state = flip >= minSyncs && flip <= NUM_SYNCS ? (byte) (one ? T1 : T2) : (byte) T3;
+    if (!(pos | bits)) {
+      deviationSum = maxDeviation = 0;
+      minMargin = ~(word) 0;
+    }
+    word lower = one ? timing.oneWidth : timing.zeroWidth;
+    word upper = one ? timing.syncWidth : timing.oneWidth;
+    word room = width - lower < upper - 1 - width ? width - lower : upper - 1 - width;
+    if (room < minMargin)
+      minMargin = room;
+    deviate(width, timing.nominalHigh[one]);
+    margins[8 * pos + bits] = (uint32_t) (width < timing.oneWidth ? timing.oneWidth - width : width - timing.oneWidth);
+  }
+
+  // the zero half of a data bit, which stores it
+  char lowBit (word width, int one) {
+    // the decoder takes any low half, so those have no margin to speak of
+    deviate(width, timing.nominalLow[one]);
+    shiftBit(one);
+    if (pos >= 7) {
+      // Data ready to receive - packets are 7 bytes long
+      flushBits();
+      return 1;
+    }
+    return 0;
+  }
+
+  // OK is invoked at the pos-to-0 transition, T0 - T2 at the 0-to-pos one
+  // that ends the zero-pulse half of a sync/1/0 bit.
+  char decode (word width) {
+    // Every non-zero width gives the same action in the low-half states,
+    // so only OK and T0 need the five compares.
+    byte column = state == OK || state == T0 ? classify(width) : width != 0;
+    byte action = acuRiteActions[state][column];
+    switch (action) {
+    case ACURITE_FAIL:
+      return -1;
+    case ACURITE_STAY:
+      break;
+    case ACURITE_TO_OK:
       state = OK;
       break;
-    case OK:
-      // OK invoked at pos-to-0 transition. Look at width, figure out what 
-      // kind of pulse this is (SYNC/0/1)
-
-      if (width > BIT_WIDTH) {
-	// Dunno what data we have; it's bad.
-	state = UNKNOWN;
-	ret = -1;
-      } else if (width >= SYNC_WIDTH) {
-	// sync bit
-	state = T0; // T0: expecting zero-pulse for SYNC of 584-600mS
-      } else if (width >= ONE_WIDTH) {
-	if (flip != NUM_SYNCS) {
-	  state = T3;
-	  return 0;
-	}
-	state = T1; // T1: expecting zero-pulse for 1-bit of 180-200mS
-      } else if (width >= ZERO_WIDTH) {
-	if (flip != NUM_SYNCS) {
-	  state = T3;
-	  return 0;
-	}
-	state = T2; // T2: expecting zero-pulse for 0-bit of 584-800mS
-      }
+    case ACURITE_TO_T0:
+      state = T0;
       break;
-
-      // States T0 - T2: receiving the zero-pulse half. Set to state = OK
-      // if we receive it as expected, and reset if not?
-    case T0: // Sync bits.
-      if (width > MAX_SYNC_WIDTH) {
-	// reject: the trailing edge is too long, so it's not a sync.
-	state = UNKNOWN;
-	return -1;
-      }
-      if (width < SYNC_WIDTH) {
-	// We might have missed a transition, and this is the start of a 1/0 -
-	// change state, increment sync counter, and re-process it
-	flip++;
-	state = OK;
-	return decode(width);
-      }
-
+    case ACURITE_SYNC:
       flip++; // use flip to count sync bits
       state = OK;
       break;
-    case T1:
-	gotBit(1);
-	if (pos >= 7) {
-	  // Data ready to receive - packets are 7 bytes long
-	  reverseBits();
-	  return 1;
-	}
-
-	break;
-    case T2:
-      gotBit(0);
-      
-      if (pos >= 7) {
-	// Data ready to receive - packets are 7 bytes long
-	reverseBits();
-	return 1;
-      }
-      break;
-    case T3:
-      // error condition; consume the 0-bit and then reset
-      return -1;
+    case ACURITE_SYNC_DATA0:
+    case ACURITE_SYNC_DATA1:
+      flip++;
+      // fall through
+    case ACURITE_DATA0:
+    case ACURITE_DATA1:
+      dataBit(width, action & 1);
       break;
+    case ACURITE_BIT0:
+    case ACURITE_BIT1:
+      return lowBit(width, action & 1);
     }
 
-    return ret;
+    return 0;
   }
-
 };
 
 
@@ -214,3 +433,5 @@ typedef struct {
     const char* name;
     DecodeOOK* decoder;
 } DecoderInfo;
+
+#endif //ACURITE_DECODERS_H
@@ -1,2 +1,5 @@
+#include <stdint.h>
+
 typedef unsigned char byte;
-typedef unsigned long word;
+// Pulse widths and sample positions; 64 bits so long, fast captures don't wrap
+typedef uint64_t word;
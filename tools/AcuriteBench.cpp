@@ -0,0 +1,888 @@
+// Decoder throughput benchmark. Synthesizes pulse streams the way the
+// simulation data generator does (AcuriteSimulationTiming.h), then times each
+// stage of the decoder on them: the AcuRiteDecoder state machine on its own
+// (and, for comparison, the switch it replaced, which must agree with it),
+// packet validation, the edge decoder, and the edge decoder feeding a packet
+// arena and text formatting as the analyzer's results do; and crc16.h's
+// buffer CRCs beside their bit-serial forms. Prints one JSON object per
+// stream and stage, so runs from different builds can be diffed.
+// Before timing anything it checks that a capture crossing sample 2^32
+// decodes the same as one starting at zero, and that crc16.h's buffer CRCs
+// agree with the bit-serial ones, and exits 1 if either doesn't.
+//
+//   AcuriteBench [-r rate] [-b bursts] [-n runs] [-t threads] [-g us] [-s stream] [-l label]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "AcuriteChannelDecoder.h"
+#include "AcuriteSimulationTiming.h"
+
+#define BENCH_DEFAULT_RATE 4000000
+#define BENCH_DEFAULT_BURSTS 5000
+#define BENCH_DEFAULT_RUNS 3
+#define BENCH_DEFAULT_GLITCH_US 90
+
+// Between bursts of the clean, jittered, noisy and spiky streams
+#define BENCH_BURST_GAP_US 200000
+// Between bursts of the idle stream, as the simulator sends them
+#define BENCH_IDLE_GAP_US 30000000
+// The boundary check: a 24 MHz capture starting this far before sample 2^32
+#define BENCH_BOUNDARY_RATE 24000000
+#define BENCH_BOUNDARY_LEAD_US 3000000
+#define BENCH_BOUNDARY_BURSTS 30
+// The CRC check: random buffers of up to this many bytes, from random start values
+#define BENCH_CRC_CHECKS 50000
+#define BENCH_CRC_CHECK_MAX_BYTES 64
+// The CRC stages hash this much data, this many bytes at a time
+#define BENCH_CRC_BYTES ( 1 << 20 )
+static const size_t kBenchCrcBlocks[] = { 7, 64, 4096 };
+// Jitter on every pulse edge: keeps a sync pulse (SYNCHIGH) under MAX_SYNC_WIDTH
+#define BENCH_JITTER_US 8
+// Noise pulses, filling the gap before each burst of the noisy stream
+#define BENCH_NOISE_MIN_US 20
+#define BENCH_NOISE_MAX_US 1500
+// Spikes and the gaps between them, for the spiky stream: what a cheap
+// receiver hears between transmissions
+#define BENCH_SPIKE_MIN_US 2
+#define BENCH_SPIKE_MAX_US 60
+#define BENCH_SPIKE_GAP_MAX_US 300
+
+// Every allocation made while a stage runs, on any thread
+static std::atomic< uint64_t > gAllocations( 0 );
+static std::atomic< uint64_t > gAllocatedBytes( 0 );
+
+void* operator new( size_t size )
+{
+	gAllocations++;
+	gAllocatedBytes += size;
+	void* p = malloc( size ? size : 1 );
+	if( p == NULL )
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[]( size_t size ) { return operator new( size ); }
+void* operator new( size_t size, const std::nothrow_t& ) noexcept
+{
+	gAllocations++;
+	gAllocatedBytes += size;
+	return malloc( size ? size : 1 );
+}
+void* operator new[]( size_t size, const std::nothrow_t& tag ) noexcept { return operator new( size, tag ); }
+void operator delete( void* p ) noexcept { free( p ); }
+void operator delete[]( void* p ) noexcept { free( p ); }
+void operator delete( void* p, size_t ) noexcept { free( p ); }
+void operator delete[]( void* p, size_t ) noexcept { free( p ); }
+
+// A synthesized capture: edges starting with a rising one, as the analyzer
+// feeds them to its decoder
+struct BenchStream
+{
+	const char* mName;
+	std::vector< uint64_t > mEdges;
+	uint64_t mPacketsSent;
+};
+
+class StreamBuilder
+{
+public:
+	StreamBuilder( BenchStream& stream, uint32_t rate, uint32_t jitter_us, uint64_t start = 0 )
+	:	mStream( stream ), mRate( rate ), mJitterUs( jitter_us ), mNow( start ), mRandom( 0x2545F4914F6CDD1Dull ) {}
+
+	// A high pulse and the low time after it
+	void Pulse( uint32_t high_us, uint32_t low_us )
+	{
+		mStream.mEdges.push_back( mNow );
+		mNow += Samples( Jitter( high_us ) );
+		mStream.mEdges.push_back( mNow );
+		mNow += Samples( Jitter( low_us ) );
+	}
+
+	void Idle( uint64_t us ) { mNow += Samples( us ); }
+
+	// SIM_COPIES copies of a random, valid packet
+	void Burst()
+	{
+		uint8_t packet[ 7 ];
+		RandomPacket( packet );
+
+		for( int copy = 0; copy < SIM_COPIES; copy++ )
+		{
+			for( int i = 0; i < 4; i++ )
+				Pulse( SYNCHIGH, SYNCLOW );
+			for( int bit = 0; bit < 56; bit++ )
+			{
+				if( packet[ bit / 8 ] & ( 0x80 >> ( bit % 8 ) ) )
+					Pulse( ONEHIGH, ONELOW );
+				else
+					Pulse( ZEROHIGH, ZEROLOW );
+			}
+			Pulse( STOPHIGH, copy + 1 < SIM_COPIES ? SYNCLOW : 0 );
+			mStream.mPacketsSent++;
+		}
+	}
+
+	// Random pulses for about us
+	void Noise( uint64_t us )
+	{
+		uint64_t end = mNow + Samples( us );
+		while( mNow < end )
+			Pulse( Uniform( BENCH_NOISE_MIN_US, BENCH_NOISE_MAX_US ), Uniform( BENCH_NOISE_MIN_US, BENCH_NOISE_MAX_US ) );
+	}
+
+	// Short spikes for about us
+	void Spikes( uint64_t us )
+	{
+		uint64_t end = mNow + Samples( us );
+		while( mNow < end )
+			Pulse( Uniform( BENCH_SPIKE_MIN_US, BENCH_SPIKE_MAX_US ), Uniform( BENCH_SPIKE_MIN_US, BENCH_SPIKE_GAP_MAX_US ) );
+	}
+
+protected:
+	uint64_t Samples( uint64_t us ) const { return us * mRate / 1000000; }
+
+	uint32_t Jitter( uint32_t us )
+	{
+		if( mJitterUs == 0 || us == 0 )
+			return us;
+		return us - mJitterUs + Uniform( 0, 2 * mJitterUs );
+	}
+
+	// xorshift64: the same streams every run
+	uint64_t Next()
+	{
+		mRandom ^= mRandom << 13;
+		mRandom ^= mRandom >> 7;
+		mRandom ^= mRandom << 17;
+		return mRandom;
+	}
+
+	uint32_t Uniform( uint32_t low, uint32_t high ) { return low + (uint32_t)( Next() % ( high - low + 1 ) ); }
+
+	void RandomPacket( uint8_t* packet )
+	{
+		static const uint8_t channels[] = { 0xC0, 0x80, 0x00 };
+		packet[ 0 ] = channels[ Next() % 3 ] | ( Next() % 63 );
+		packet[ 1 ] = Next() % 127;
+		packet[ 2 ] = 0x44;
+		packet[ 3 ] = Next() % 100;
+		packet[ 4 ] = Next() % 15;
+		packet[ 5 ] = Next() % 127;
+		for( int i = 1; i <= 5; i++ )
+			packet[ i ] |= AcuriteParityBit( packet[ i ] );
+
+		uint8_t checksum = 0;
+		for( int i = 0; i <= 5; i++ )
+			checksum += packet[ i ];
+		packet[ 6 ] = checksum;
+	}
+
+	BenchStream& mStream;
+	uint32_t mRate;
+	uint32_t mJitterUs;
+	uint64_t mNow;
+	uint64_t mRandom;
+};
+
+static void BuildStream( BenchStream& stream, const char* name, uint32_t rate, uint32_t bursts, uint64_t start = 0 )
+{
+	stream.mName = name;
+	stream.mPacketsSent = 0;
+
+	bool jitter = strcmp( name, "jitter" ) == 0;
+	bool noise = strcmp( name, "noise" ) == 0;
+	bool idle = strcmp( name, "idle" ) == 0;
+	bool spikes = strcmp( name, "spikes" ) == 0;
+
+	StreamBuilder builder( stream, rate, jitter ? BENCH_JITTER_US : 0, start );
+	for( uint32_t i = 0; i < bursts; i++ )
+	{
+		if( noise )
+			builder.Noise( BENCH_BURST_GAP_US );
+		else if( spikes )
+			builder.Spikes( BENCH_BURST_GAP_US );
+		else
+			builder.Idle( idle ? BENCH_IDLE_GAP_US : BENCH_BURST_GAP_US );
+		builder.Burst();
+	}
+}
+
+struct BenchResult
+{
+	double mSeconds;
+	uint64_t mEdges;   // 0 for stages that only see packets
+	uint64_t mPackets;
+	uint64_t mAllocations;
+	uint64_t mAllocatedBytes;
+};
+
+// Counts what the decoder reports
+class CountingSink : public AcuriteDecodeSink
+{
+public:
+	CountingSink() : mMarkers( 0 ), mPackets( 0 ) {}
+	virtual void OnMarker( uint64_t sample ) { mMarkers++; }
+	virtual void OnPacket( const AcuritePacket& packet ) { mPackets++; }
+
+	uint64_t mMarkers;
+	uint64_t mPackets;
+};
+
+// What AcuriteResultsSink does without the SDK: packets into an arena and
+// markers into a list, and the text the GUI would ask for
+class ResultsSink : public AcuriteDecodeSink
+{
+public:
+	ResultsSink() : mTextBytes( 0 ) {}
+
+	virtual void OnMarker( uint64_t sample ) { mMarkers.push_back( sample ); }
+
+	virtual void OnPacket( const AcuritePacket& packet )
+	{
+		uint64_t index = mArena.Add( packet );
+		char text[ 128 ];
+		mTextBytes += AcuriteFormatPacket( mArena.Get( index ), text );
+	}
+
+	AcuritePacketArena mArena;
+	std::vector< uint64_t > mMarkers;
+	uint64_t mTextBytes;
+};
+
+// Everything the decoder reports, with sample positions relative to the
+// start of the stream
+class RecordingSink : public AcuriteDecodeSink
+{
+public:
+	RecordingSink( uint64_t start ) : mStart( start ) {}
+
+	virtual void OnMarker( uint64_t sample ) { mMarkers.push_back( sample - mStart ); }
+
+	virtual void OnPacket( const AcuritePacket& packet )
+	{
+		mPackets.push_back( packet );
+		mPackets.back().mStartSample -= mStart;
+		mPackets.back().mEndSample -= mStart;
+	}
+
+	uint64_t mStart;
+	std::vector< uint64_t > mMarkers;
+	std::vector< AcuritePacket > mPackets;
+};
+
+static bool SamePacket( const AcuritePacket& a, const AcuritePacket& b )
+{
+	return a.mStartSample == b.mStartSample && a.mEndSample == b.mEndSample &&
+		a.mSensorId == b.mSensorId && a.mRawTemperature == b.mRawTemperature &&
+		a.mChannel == b.mChannel && a.mHumidity == b.mHumidity && a.mFlags == b.mFlags &&
+		a.mSize == b.mSize && memcmp( a.mData, b.mData, sizeof a.mData ) == 0 &&
+		a.mRepeats == b.mRepeats && a.mSyncs == b.mSyncs && a.mCopy == b.mCopy &&
+		a.mMeanDeviation == b.mMeanDeviation && a.mMaxDeviation == b.mMaxDeviation &&
+		a.mMinMargin == b.mMinMargin;
+}
+
+static void DecodeStream( const BenchStream& stream, const AcuriteDecoderOptions& options, unsigned threads, RecordingSink& sink )
+{
+	AcuriteChannelDecoder decoder( options, threads );
+	bool high = true;
+	for( size_t i = 0; i < stream.mEdges.size(); i++, high = !high )
+		decoder.Edge( stream.mEdges[ i ], high, sink );
+	decoder.Finish( sink );
+}
+
+// The same capture starting at sample 0 and a few seconds before 2^32 must
+// decode to the same packets at the same (relative) positions
+static bool CheckBoundary( unsigned threads )
+{
+	const uint64_t start = ( 1ull << 32 ) - (uint64_t)BENCH_BOUNDARY_LEAD_US * BENCH_BOUNDARY_RATE / 1000000;
+	AcuriteDecoderOptions options( BENCH_BOUNDARY_RATE );
+
+	BenchStream zero, shifted;
+	BuildStream( zero, "clean", BENCH_BOUNDARY_RATE, BENCH_BOUNDARY_BURSTS );
+	BuildStream( shifted, "clean", BENCH_BOUNDARY_RATE, BENCH_BOUNDARY_BURSTS, start );
+	if( shifted.mEdges.back() <= ( 1ull << 32 ) )
+	{
+		fprintf( stderr, "boundary check: the stream ends before sample 2^32\n" );
+		return false;
+	}
+
+	RecordingSink expected( 0 ), got( start );
+	DecodeStream( zero, options, threads, expected );
+	DecodeStream( shifted, options, threads, got );
+
+	if( expected.mPackets.empty() )
+	{
+		fprintf( stderr, "boundary check: no packets decoded\n" );
+		return false;
+	}
+	if( got.mPackets.size() != expected.mPackets.size() )
+	{
+		fprintf( stderr, "boundary check: %llu packets from sample %llu, %llu from sample 0\n",
+			(unsigned long long)got.mPackets.size(), (unsigned long long)start, (unsigned long long)expected.mPackets.size() );
+		return false;
+	}
+	for( size_t i = 0; i < expected.mPackets.size(); i++ )
+	{
+		if( !SamePacket( got.mPackets[ i ], expected.mPackets[ i ] ) )
+		{
+			fprintf( stderr, "boundary check: packet %llu differs (samples %llu-%llu from 0, %llu-%llu from %llu)\n",
+				(unsigned long long)i,
+				(unsigned long long)expected.mPackets[ i ].mStartSample, (unsigned long long)expected.mPackets[ i ].mEndSample,
+				(unsigned long long)got.mPackets[ i ].mStartSample, (unsigned long long)got.mPackets[ i ].mEndSample,
+				(unsigned long long)start );
+			return false;
+		}
+	}
+	if( got.mMarkers != expected.mMarkers )
+	{
+		fprintf( stderr, "boundary check: markers differ\n" );
+		return false;
+	}
+
+	printf( "{\"stage\":\"boundary\",\"rate\":%u,\"threads\":%u,\"start\":%llu,\"end\":%llu,\"packets\":%llu,\"ok\":true}\n",
+		BENCH_BOUNDARY_RATE, threads, (unsigned long long)start, (unsigned long long)shifted.mEdges.back(),
+		(unsigned long long)got.mPackets.size() );
+	fflush( stdout );
+	return true;
+}
+
+class StageTimer
+{
+public:
+	StageTimer()
+	:	mAllocations( gAllocations ), mAllocatedBytes( gAllocatedBytes ),
+		mStart( std::chrono::steady_clock::now() ) {}
+
+	void Stop( BenchResult& result ) const
+	{
+		result.mSeconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - mStart ).count();
+		result.mAllocations = gAllocations - mAllocations;
+		result.mAllocatedBytes = gAllocatedBytes - mAllocatedBytes;
+	}
+
+	uint64_t mAllocations;
+	uint64_t mAllocatedBytes;
+	std::chrono::steady_clock::time_point mStart;
+};
+
+// AcuRiteDecoder as it was before the transition table: a nested switch,
+// called through DecodeOOK's virtual decode(), that re-decodes a short pulse
+// in T0 by calling itself. Kept to time the table against and to check that
+// the two still agree. It keeps the table decoder's minSyncs rule and its
+// margins and signal figures, so the stages differ only in how they pick a
+// transition and in the virtual call.
+class SwitchAcuRiteDecoder : public DecodeOOK
+{
+public:
+	AcuRiteTiming timing;
+	byte minSyncs;
+	uint32_t margins[ 56 ];
+	uint64_t deviationSum;
+	word maxDeviation, minMargin;
+
+	SwitchAcuRiteDecoder() : minSyncs( NUM_SYNCS ), deviationSum( 0 ), maxDeviation( 0 ), minMargin( 0 ) {}
+
+	void setSampleRate( unsigned long sampleRateHz ) { timing.setSampleRate( sampleRateHz ); }
+
+	void deviate( word width, word nominal )
+	{
+		word off = width > nominal ? width - nominal : nominal - width;
+		deviationSum += off;
+		if( off > maxDeviation )
+			maxDeviation = off;
+	}
+
+	// The positive half of a data bit
+	void data( word width, bool one )
+	{
+		state = flip >= minSyncs && flip <= NUM_SYNCS ? ( one ? (byte)T1 : (byte)T2 ) : (byte)T3;
+		if( !( pos | bits ) )
+		{
+			deviationSum = maxDeviation = 0;
+			minMargin = ~(word)0;
+		}
+		word lower = one ? timing.oneWidth : timing.zeroWidth;
+		word upper = one ? timing.syncWidth : timing.oneWidth;
+		word room = width - lower < upper - 1 - width ? width - lower : upper - 1 - width;
+		if( room < minMargin )
+			minMargin = room;
+		deviate( width, timing.nominalHigh[ one ] );
+		margins[ 8 * pos + bits ] = (uint32_t)( width < timing.oneWidth ? timing.oneWidth - width : width - timing.oneWidth );
+	}
+
+	// Out of line: a compiler that guesses the one override there is can skip
+	// the vtable load, but still has to call it
+	virtual __attribute__((noinline)) char decode( word width )
+	{
+		if( !width )
+			return -1;
+
+		switch( state )
+		{
+		case UNKNOWN:
+			// 0-to-positive initial transition
+			state = OK;
+			break;
+		case OK:
+			// the positive half says SYNC/0/1
+			if( width > timing.bitWidth )
+			{
+				state = UNKNOWN;
+				return -1;
+			}
+			else if( width >= timing.syncWidth )
+				state = T0;
+			else if( width >= timing.oneWidth )
+				data( width, true );
+			else if( width >= timing.zeroWidth )
+				data( width, false );
+			break;
+		case T0:
+			if( width > timing.maxSyncWidth )
+			{
+				state = UNKNOWN;
+				return -1;
+			}
+			flip++; // use flip to count sync bits
+			state = OK;
+			if( width < timing.syncWidth )
+				return decode( width ); // a missed transition: the start of a 1/0
+			break;
+		case T1:
+		case T2:
+			deviate( width, timing.nominalLow[ state == T1 ] );
+			shiftBit( state == T1 );
+			if( pos >= 7 )
+			{
+				flushBits();
+				return 1;
+			}
+			break;
+		case T3:
+			// consume the 0-bit and then reset
+			return -1;
+		}
+		return 0;
+	}
+};
+
+// Out of line, so the compiler can't tell what the bench calls decode() on
+// and has to make the virtual call, as the analyzer did
+static __attribute__((noinline)) DecodeOOK* SwitchDecoder( uint32_t rate )
+{
+	static SwitchAcuRiteDecoder decoder;
+	decoder.setSampleRate( rate );
+	return &decoder;
+}
+
+// The state machine alone: pulse widths in, raw packets out
+template< typename Decoder >
+static BenchResult BenchNextPulse( const BenchStream& stream, Decoder& decoder, std::vector< uint8_t >* raw_packets )
+{
+	BenchResult result;
+	result.mEdges = stream.mEdges.size();
+	result.mPackets = 0;
+
+	StageTimer timer;
+	decoder.resetDecoder();
+
+	// Like AcuriteEdgeDecoder, drop the edge after a packet that finishes high
+	const uint64_t* edges = stream.mEdges.data();
+	uint64_t last = 0;
+	bool high = true;
+	bool skip = false;
+	for( size_t i = 0; i < stream.mEdges.size(); i++, high = !high )
+	{
+		if( skip )
+		{
+			skip = false;
+			continue;
+		}
+		if( decoder.nextPulse( edges[ i ] - last ) )
+		{
+			result.mPackets++;
+			if( raw_packets != NULL )
+			{
+				byte size;
+				const byte* data = decoder.getData( size );
+				if( size == 7 )
+					raw_packets->insert( raw_packets->end(), data, data + 7 );
+			}
+			decoder.resetDecoder();
+			skip = high;
+		}
+		last = edges[ i ];
+	}
+	timer.Stop( result );
+	return result;
+}
+
+// Decoder output to AcuritePacket, one at a time (what replaced interpretData)
+static BenchResult BenchDecodePacket( const std::vector< uint8_t >& raw_packets )
+{
+	BenchResult result;
+	result.mEdges = 0;
+	result.mPackets = raw_packets.size() / 7;
+
+	uint64_t valid = 0;
+	StageTimer timer;
+	for( size_t i = 0; i + 7 <= raw_packets.size(); i += 7 )
+	{
+		AcuritePacket packet;
+		AcuriteDecodePacket( &raw_packets[ i ], 7, packet );
+		valid += ( packet.mFlags & ACURITE_PACKET_ERRORS ) == 0;
+	}
+	timer.Stop( result );
+
+	// Keep the loop from being optimized away
+	if( valid > result.mPackets )
+		abort();
+	return result;
+}
+
+// The same packets validated 64 at a time
+static BenchResult BenchValidatePackets( const std::vector< uint8_t >& raw_packets )
+{
+	BenchResult result;
+	result.mEdges = 0;
+	result.mPackets = raw_packets.size() / 7;
+
+	uint64_t bad = 0;
+	StageTimer timer;
+	for( size_t i = 0; i < result.mPackets; i += 64 )
+	{
+		size_t count = result.mPackets - i < 64 ? result.mPackets - i : 64;
+		bad |= AcuriteValidatePackets( &raw_packets[ i * 7 ], count );
+	}
+	timer.Stop( result );
+
+	if( bad == 0xDEADBEEFull )
+		abort();
+	return result;
+}
+
+static uint64_t SinkPackets( const CountingSink& sink ) { return sink.mPackets; }
+static uint64_t SinkPackets( const ResultsSink& sink ) { return sink.mArena.GetCount(); }
+
+// Edges through AcuriteChannelDecoder, as DecodeInput() feeds them
+template< typename Sink >
+static BenchResult BenchChannelDecoder( const BenchStream& stream, const AcuriteDecoderOptions& options, unsigned threads, uint64_t& packets )
+{
+	BenchResult result;
+	result.mEdges = stream.mEdges.size();
+
+	StageTimer timer;
+	{
+		Sink sink;
+		AcuriteChannelDecoder decoder( options, threads );
+		bool high = true;
+		const uint64_t* edges = stream.mEdges.data();
+		for( size_t i = 0; i < stream.mEdges.size(); i++ )
+		{
+			decoder.Edge( edges[ i ], high, sink );
+			high = !high;
+		}
+		decoder.Finish( sink );
+		packets = SinkPackets( sink );
+	}
+	timer.Stop( result );
+
+	result.mPackets = packets;
+	return result;
+}
+
+static void Report( const char* label, const BenchStream& stream, const char* stage, uint32_t rate, unsigned threads, const BenchResult& result )
+{
+	printf( "{\"label\":\"%s\",\"stream\":\"%s\",\"stage\":\"%s\",\"rate\":%u,\"threads\":%u,"
+		"\"edges\":%llu,\"packets\":%llu,\"packets_sent\":%llu,\"seconds\":%.6f,",
+		label, stream.mName, stage, rate, threads,
+		(unsigned long long)result.mEdges, (unsigned long long)result.mPackets,
+		(unsigned long long)stream.mPacketsSent, result.mSeconds );
+
+	if( result.mEdges != 0 )
+		printf( "\"edges_per_s\":%.0f,\"ns_per_edge\":%.3f,", result.mEdges / result.mSeconds, result.mSeconds * 1e9 / result.mEdges );
+	else
+		printf( "\"edges_per_s\":null,\"ns_per_edge\":null," );
+
+	if( result.mPackets != 0 )
+		printf( "\"ns_per_packet\":%.3f,", result.mSeconds * 1e9 / result.mPackets );
+	else
+		printf( "\"ns_per_packet\":null," );
+
+	printf( "\"allocs\":%llu,\"alloc_bytes\":%llu}\n",
+		(unsigned long long)result.mAllocations, (unsigned long long)result.mAllocatedBytes );
+	fflush( stdout );
+}
+
+// The fastest of runs; allocations are the same every run
+template< typename Run >
+static BenchResult Best( unsigned runs, Run run )
+{
+	BenchResult best = run();
+	for( unsigned i = 1; i < runs; i++ )
+	{
+		BenchResult result = run();
+		if( result.mSeconds < best.mSeconds )
+			best = result;
+	}
+	if( best.mSeconds <= 0 )
+		best.mSeconds = 1e-9;
+	return best;
+}
+
+// A buffer CRC, as crc16.h has them; the 8-bit iButton CRC is widened
+typedef uint16_t ( *CrcFunction )( const uint8_t* data, size_t len, uint16_t crc );
+
+// The bit-serial reference: Update folded over the buffer
+template< uint16_t ( *Update )( uint16_t, uint8_t ) >
+static uint16_t SerialCrc( const uint8_t* data, size_t len, uint16_t crc )
+{
+	for( size_t i = 0; i < len; i++ )
+		crc = Update( crc, data[ i ] );
+	return crc;
+}
+
+static uint16_t IButtonUpdate( uint16_t crc, uint8_t data ) { return _crc_ibutton_update( (uint8_t)crc, data ); }
+static uint16_t IButtonCrc( const uint8_t* data, size_t len, uint16_t crc ) { return crc_ibutton( data, len, (uint8_t)crc ); }
+
+static uint64_t CrcRandom( uint64_t& state )
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+// Every buffer and start value must give the same CRC both ways
+template< CrcFunction Serial, CrcFunction Sliced >
+static bool CheckCrc( const char* name, uint16_t mask )
+{
+	uint64_t random = 0x9E3779B97F4A7C15ull;
+	uint8_t data[ BENCH_CRC_CHECK_MAX_BYTES ];
+	for( int i = 0; i < BENCH_CRC_CHECKS; i++ )
+	{
+		size_t len = CrcRandom( random ) % ( BENCH_CRC_CHECK_MAX_BYTES + 1 );
+		uint16_t start = (uint16_t)( CrcRandom( random ) & mask );
+		for( size_t j = 0; j < len; j++ )
+			data[ j ] = (uint8_t)CrcRandom( random );
+
+		uint16_t expected = Serial( data, len, start );
+		uint16_t got = Sliced( data, len, start );
+		if( got != expected )
+		{
+			fprintf( stderr, "crc check: %s of %llu bytes from 0x%04X is 0x%04X, bit-serially 0x%04X\n",
+				name, (unsigned long long)len, start, got, expected );
+			return false;
+		}
+	}
+	return true;
+}
+
+// Crc over data, block bytes at a time; sum collects the results
+template< CrcFunction Crc >
+static BenchResult BenchCrc( const std::vector< uint8_t >& data, size_t block, uint16_t& sum )
+{
+	BenchResult result;
+	result.mEdges = 0;
+	result.mPackets = data.size() / block;
+
+	uint16_t total = 0;
+	StageTimer timer;
+	for( size_t i = 0; i + block <= data.size(); i += block )
+		total ^= Crc( &data[ i ], block, (uint16_t)i );
+	timer.Stop( result );
+
+	sum = total;
+	return result;
+}
+
+static void ReportCrc( const char* label, const char* stage, size_t block, const BenchResult& result )
+{
+	double bytes = (double)result.mPackets * block;
+	printf( "{\"label\":\"%s\",\"stream\":\"crc\",\"stage\":\"%s\",\"bytes\":%llu,\"buffers\":%llu,"
+		"\"seconds\":%.6f,\"mb_per_s\":%.1f,\"ns_per_buffer\":%.3f}\n",
+		label, stage, (unsigned long long)block, (unsigned long long)result.mPackets, result.mSeconds,
+		bytes / result.mSeconds / 1e6, result.mSeconds * 1e9 / result.mPackets );
+	fflush( stdout );
+}
+
+// Checks one CRC, then times it both ways on each buffer size. False if the
+// two disagree.
+template< CrcFunction Serial, CrcFunction Sliced >
+static bool RunCrc( const char* name, uint16_t mask, const std::vector< uint8_t >* data, unsigned runs, const char* label )
+{
+	if( !CheckCrc< Serial, Sliced >( name, mask ) )
+		return false;
+	if( data == NULL )
+		return true;
+
+	std::string serial_name = std::string( name ) + "-serial";
+	for( size_t b = 0; b < sizeof kBenchCrcBlocks / sizeof kBenchCrcBlocks[ 0 ]; b++ )
+	{
+		size_t block = kBenchCrcBlocks[ b ];
+		uint16_t serial_sum, sliced_sum;
+		ReportCrc( label, serial_name.c_str(), block,
+			Best( runs, [&]() { return BenchCrc< Serial >( *data, block, serial_sum ); } ) );
+		ReportCrc( label, name, block,
+			Best( runs, [&]() { return BenchCrc< Sliced >( *data, block, sliced_sum ); } ) );
+		if( ( serial_sum ^ sliced_sum ) & mask )
+		{
+			fprintf( stderr, "crc check: %s disagrees with the bit-serial CRC on %llu-byte buffers\n",
+				name, (unsigned long long)block );
+			return false;
+		}
+	}
+	return true;
+}
+
+// The buffer CRCs against the bit-serial ones; timed too, unless data is NULL
+static bool CheckCrcs( const std::vector< uint8_t >* data, unsigned runs, const char* label )
+{
+	return RunCrc< SerialCrc< _crc16_update >, crc16 >( "crc16", 0xFFFF, data, runs, label ) &&
+		RunCrc< SerialCrc< _crc_xmodem_update >, crc_xmodem >( "crc_xmodem", 0xFFFF, data, runs, label ) &&
+		RunCrc< SerialCrc< _crc_ccitt_update >, crc_ccitt >( "crc_ccitt", 0xFFFF, data, runs, label ) &&
+		RunCrc< SerialCrc< IButtonUpdate >, IButtonCrc >( "crc_ibutton", 0xFF, data, runs, label );
+}
+
+// Two stages run turn about, the fastest of each kept, so a machine that
+// speeds up or slows down over the runs doesn't favour either
+template< typename RunA, typename RunB >
+static void BestPair( unsigned runs, RunA run_a, RunB run_b, BenchResult& best_a, BenchResult& best_b )
+{
+	best_a = run_a();
+	best_b = run_b();
+	for( unsigned i = 1; i < runs; i++ )
+	{
+		BenchResult a = run_a();
+		if( a.mSeconds < best_a.mSeconds )
+			best_a = a;
+		BenchResult b = run_b();
+		if( b.mSeconds < best_b.mSeconds )
+			best_b = b;
+	}
+	if( best_a.mSeconds <= 0 )
+		best_a.mSeconds = 1e-9;
+	if( best_b.mSeconds <= 0 )
+		best_b.mSeconds = 1e-9;
+}
+
+static void Usage()
+{
+	fprintf( stderr,
+		"usage: AcuriteBench [-r rate] [-b bursts] [-n runs] [-t threads] [-g us] [-s stream] [-l label]\n"
+		"  -r  sample rate, in Hz (default %d)\n"
+		"  -b  bursts of %d packets per stream (default %d)\n"
+		"  -n  runs per stage; the fastest is reported (default %d)\n"
+		"  -t  decode threads for the channel decoder stages (default 1)\n"
+		"  -g  glitch filter width for the deglitch stage, in uS (default %d)\n"
+		"  -s  only this stream: clean, jitter, noise, idle or spikes, or crc for the CRC stages\n"
+		"  -l  label copied into every line, to tell builds apart\n",
+		BENCH_DEFAULT_RATE, SIM_COPIES, BENCH_DEFAULT_BURSTS, BENCH_DEFAULT_RUNS, BENCH_DEFAULT_GLITCH_US );
+	exit( 2 );
+}
+
+int main( int argc, char** argv )
+{
+	uint32_t rate = BENCH_DEFAULT_RATE;
+	uint32_t bursts = BENCH_DEFAULT_BURSTS;
+	unsigned runs = BENCH_DEFAULT_RUNS;
+	unsigned threads = 1;
+	uint32_t glitch_us = BENCH_DEFAULT_GLITCH_US;
+	const char* only = NULL;
+	const char* label = "";
+
+	for( int arg = 1; arg < argc; arg += 2 )
+	{
+		const char* flag = argv[ arg ];
+		if( flag[ 0 ] != '-' || flag[ 1 ] == 0 || flag[ 2 ] != 0 || arg + 1 >= argc )
+			Usage();
+
+		const char* value = argv[ arg + 1 ];
+		switch( flag[ 1 ] )
+		{
+		case 'r': rate = strtoul( value, NULL, 10 ); break;
+		case 'b': bursts = strtoul( value, NULL, 10 ); break;
+		case 'n': runs = strtoul( value, NULL, 10 ); break;
+		case 't': threads = strtoul( value, NULL, 10 ); break;
+		case 'g': glitch_us = strtoul( value, NULL, 10 ); break;
+		case 's': only = value; break;
+		case 'l': label = value; break;
+		default: Usage();
+		}
+	}
+	if( rate == 0 || bursts == 0 || runs == 0 || threads == 0 || glitch_us > ACURITE_GLITCH_MAX_US )
+		Usage();
+
+	if( !CheckBoundary( threads ) )
+		return 1;
+
+	// The CRC stages time what they check; without them, just check
+	std::vector< uint8_t > crc_data;
+	bool time_crcs = only == NULL || strcmp( only, "crc" ) == 0;
+	if( time_crcs )
+	{
+		uint64_t random = 0x2545F4914F6CDD1Dull;
+		crc_data.resize( BENCH_CRC_BYTES );
+		for( size_t i = 0; i < crc_data.size(); i++ )
+			crc_data[ i ] = (uint8_t)CrcRandom( random );
+	}
+	if( !CheckCrcs( time_crcs ? &crc_data : NULL, runs, label ) )
+		return 1;
+
+	static const char* streams[] = { "clean", "jitter", "noise", "idle", "spikes" };
+	AcuriteDecoderOptions options( rate );
+	AcuriteDecoderOptions deglitch_options( rate );
+	deglitch_options.mGlitchWidthUs = glitch_us;
+
+	for( size_t s = 0; s < sizeof streams / sizeof streams[ 0 ]; s++ )
+	{
+		if( only != NULL && strcmp( only, streams[ s ] ) != 0 )
+			continue;
+
+		BenchStream stream;
+		BuildStream( stream, streams[ s ], rate, bursts );
+
+		AcuRiteDecoder table;
+		table.setSampleRate( rate );
+		DecodeOOK* switch_decoder = SwitchDecoder( rate );
+
+		std::vector< uint8_t > raw_packets, switch_packets;
+		BenchNextPulse( stream, table, &raw_packets );
+		BenchNextPulse( stream, *switch_decoder, &switch_packets );
+		if( raw_packets != switch_packets )
+		{
+			fprintf( stderr, "%s: the table and switch decoders disagree (%llu and %llu packets)\n", stream.mName,
+				(unsigned long long)raw_packets.size() / 7, (unsigned long long)switch_packets.size() / 7 );
+			return 1;
+		}
+
+		BenchResult table_result, switch_result;
+		BestPair( runs,
+			[&]() { return BenchNextPulse( stream, table, NULL ); },
+			[&]() { return BenchNextPulse( stream, *switch_decoder, NULL ); },
+			table_result, switch_result );
+		Report( label, stream, "nextPulse", rate, 1, table_result );
+		Report( label, stream, "nextPulse-switch", rate, 1, switch_result );
+		Report( label, stream, "AcuriteDecodePacket", rate, 1,
+			Best( runs, [&]() { return BenchDecodePacket( raw_packets ); } ) );
+		Report( label, stream, "AcuriteValidatePackets", rate, 1,
+			Best( runs, [&]() { return BenchValidatePackets( raw_packets ); } ) );
+
+		uint64_t packets;
+		Report( label, stream, "AcuriteChannelDecoder", rate, threads,
+			Best( runs, [&]() { return BenchChannelDecoder< CountingSink >( stream, options, threads, packets ); } ) );
+		Report( label, stream, "results", rate, threads,
+			Best( runs, [&]() { return BenchChannelDecoder< ResultsSink >( stream, options, threads, packets ); } ) );
+		Report( label, stream, "deglitch", rate, threads,
+			Best( runs, [&]() { return BenchChannelDecoder< CountingSink >( stream, deglitch_options, threads, packets ); } ) );
+	}
+
+	return 0;
+}
@@ -0,0 +1,505 @@
+// Re-decodes archived captures without Logic: each file is memory-mapped and
+// its transitions go straight from the mapping into the same
+// AcuriteChannelDecoder that the analyzer's WorkerThread uses, so the packets
+// match what the plugin shows. Decoded packets go to stdout, one per line,
+// and the edge and packet rates go to stderr.
+//
+// Reads Logic 2 binary digital exports (one channel per file) and VCD files.
+//
+//   AcuriteReplay [-r rate] [-t threads] [-w repeat_ms] [-c edges] [-g us] [-s signal] [-e] [-q] file...
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "AcuriteChannelDecoder.h"
+
+// Transition times are turned into sample numbers at this rate unless -r says
+// otherwise; AcuRite pulses are hundreds of microseconds long, so 1 MHz loses
+// nothing.
+#define REPLAY_DEFAULT_RATE 1000000
+
+// Edges passed to the decoder at a time
+#define REPLAY_BATCH_EDGES 4096
+
+#define SALEAE_MAGIC "<SALEAE>"
+#define SALEAE_HEADER_SIZE 44 // magic, version, type, initial state, begin, end, count
+#define SALEAE_TYPE_DIGITAL 0
+
+struct ReplayOptions
+{
+	ReplayOptions() : mRate( REPLAY_DEFAULT_RATE ), mThreads( 1 ), mRepeatWindowMs( 0 ), mCalibrationEdges( 0 ), mSignal( NULL ), mCorrectBits( false ), mGlitchWidthUs( 0 ), mQuiet( false ) {}
+
+	uint32_t mRate;
+	unsigned mThreads;
+	uint32_t mRepeatWindowMs;
+	uint32_t mCalibrationEdges;
+	const char* mSignal; // VCD variable to decode; the first 1-bit one if NULL
+	bool mCorrectBits;
+	uint32_t mGlitchWidthUs;
+	bool mQuiet;         // count packets without printing them
+};
+
+// A whole file, read-only
+class MappedFile
+{
+public:
+	MappedFile() : mData( NULL ), mSize( 0 ) {}
+	~MappedFile()
+	{
+		if( mData != NULL )
+			munmap( (void*)mData, mSize );
+	}
+
+	bool Open( const char* path )
+	{
+		int fd = open( path, O_RDONLY );
+		if( fd < 0 )
+			return false;
+
+		struct stat st;
+		if( fstat( fd, &st ) != 0 || st.st_size == 0 )
+		{
+			close( fd );
+			return false;
+		}
+
+		void* data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		close( fd );
+		if( data == MAP_FAILED )
+			return false;
+
+		// Read front to back, once
+		madvise( data, st.st_size, MADV_SEQUENTIAL );
+		mData = (const char*)data;
+		mSize = st.st_size;
+		return true;
+	}
+
+	const char* mData;
+	size_t mSize;
+};
+
+// Prints each packet as it comes out of the decoder
+class ReplaySink : public AcuriteDecodeSink
+{
+public:
+	ReplaySink( uint32_t rate, bool quiet ) : mRate( rate ), mQuiet( quiet ), mPackets( 0 ), mBadPackets( 0 ), mCorrectedPackets( 0 ) {}
+
+	virtual void OnMarker( uint64_t sample ) {}
+
+	virtual void OnPacket( const AcuritePacket& packet )
+	{
+		mPackets++;
+		if( packet.mFlags & ACURITE_PACKET_ERRORS )
+			mBadPackets++;
+		if( packet.mFlags & ACURITE_PACKET_CORRECTED )
+			mCorrectedPackets++;
+		if( mQuiet )
+			return;
+
+		char text[ 160 ];
+		int length = snprintf( text, 32, "%.6f ", (double)packet.mStartSample / mRate );
+		length += AcuriteFormatPacket( packet, text + length );
+		text[ length++ ] = '\n';
+		fwrite( text, 1, length, stdout );
+	}
+
+	uint32_t mRate;
+	bool mQuiet;
+	uint64_t mPackets;
+	uint64_t mBadPackets;
+	uint64_t mCorrectedPackets;
+};
+
+// The rules DecodeInput() follows for the start of a capture: decoding starts
+// with the first rising edge. Edges go to the decoder in batches.
+class ReplayFeed
+{
+public:
+	ReplayFeed( AcuriteChannelDecoder& decoder, AcuriteDecodeSink& sink )
+	:	mDecoder( decoder ), mSink( sink ), mStarted( false ), mEdges( 0 ), mBatchCount( 0 ), mBatchHigh( false ) {}
+
+	void Edge( uint64_t sample, bool high )
+	{
+		if( !mStarted )
+		{
+			if( !high )
+				return;
+			mStarted = true;
+		}
+		if( mBatchCount == 0 )
+			mBatchHigh = high;
+		mBatch[ mBatchCount++ ] = sample;
+		if( mBatchCount == REPLAY_BATCH_EDGES )
+			Flush();
+		mEdges++;
+	}
+
+	void Finish()
+	{
+		Flush();
+		mDecoder.Finish( mSink );
+	}
+
+	AcuriteChannelDecoder& mDecoder;
+	AcuriteDecodeSink& mSink;
+	bool mStarted;
+	uint64_t mEdges;
+
+protected:
+	void Flush()
+	{
+		mDecoder.Edges( mBatch, mBatchCount, mBatchHigh, mSink );
+		mBatchCount = 0;
+	}
+
+	uint64_t mBatch[ REPLAY_BATCH_EDGES ];
+	size_t mBatchCount;
+	bool mBatchHigh; // line level after mBatch[ 0 ]
+};
+
+template< typename T >
+static T LoadUnaligned( const char* p )
+{
+	T value;
+	memcpy( &value, p, sizeof value );
+	return value;
+}
+
+// Logic 2 binary export of one digital channel: the header, then each
+// transition's time in seconds as a double. The level alternates from the
+// initial state.
+static bool ReplaySaleae( const MappedFile& file, const ReplayOptions& options, ReplayFeed& feed, std::string& error )
+{
+	if( file.mSize < SALEAE_HEADER_SIZE )
+	{
+		error = "truncated header";
+		return false;
+	}
+
+	int32_t version = LoadUnaligned< int32_t >( file.mData + 8 );
+	int32_t type = LoadUnaligned< int32_t >( file.mData + 12 );
+	uint32_t initial_state = LoadUnaligned< uint32_t >( file.mData + 16 );
+	double begin_time = LoadUnaligned< double >( file.mData + 20 );
+	uint64_t transitions = LoadUnaligned< uint64_t >( file.mData + 36 );
+
+	if( version < 0 || version > 1 || type != SALEAE_TYPE_DIGITAL )
+	{
+		error = "not a digital export (or an unknown version)";
+		return false;
+	}
+	if( transitions > ( file.mSize - SALEAE_HEADER_SIZE ) / sizeof( double ) )
+	{
+		error = "fewer transitions than the header says";
+		return false;
+	}
+
+	const char* times = file.mData + SALEAE_HEADER_SIZE;
+	double rate = options.mRate;
+	bool high = initial_state != 0;
+
+	for( uint64_t i = 0; i < transitions; i++ )
+	{
+		high = !high;
+		double t = LoadUnaligned< double >( times + i * sizeof( double ) ) - begin_time;
+		feed.Edge( (uint64_t)( t * rate + 0.5 ), high );
+	}
+	return true;
+}
+
+// Whitespace-separated VCD tokens, read in place
+class VcdTokens
+{
+public:
+	VcdTokens( const char* begin, const char* end ) : mPos( begin ), mEnd( end ) {}
+
+	// Sets token and length; false at the end of the file
+	bool Next( const char*& token, size_t& length )
+	{
+		while( mPos < mEnd && (unsigned char)*mPos <= ' ' )
+			mPos++;
+		if( mPos == mEnd )
+			return false;
+
+		token = mPos;
+		while( mPos < mEnd && (unsigned char)*mPos > ' ' )
+			mPos++;
+		length = mPos - token;
+		return true;
+	}
+
+	// Past the next $end
+	void SkipSection()
+	{
+		const char* token;
+		size_t length;
+		while( Next( token, length ) && !Is( token, length, "$end" ) )
+			;
+	}
+
+	static bool Is( const char* token, size_t length, const char* word )
+	{
+		return strlen( word ) == length && memcmp( token, word, length ) == 0;
+	}
+
+	const char* mPos;
+	const char* mEnd;
+};
+
+// Seconds per VCD time unit, from a $timescale section ("1ns", "10 us", ...)
+static bool ReadTimescale( VcdTokens& tokens, double& seconds )
+{
+	std::string text;
+	const char* token;
+	size_t length;
+	while( tokens.Next( token, length ) && !VcdTokens::Is( token, length, "$end" ) )
+		text.append( token, length );
+
+	char* unit;
+	double count = strtod( text.c_str(), &unit );
+	static const char* units[] = { "s", "ms", "us", "ns", "ps", "fs" };
+	double scale = 1.0;
+	for( size_t i = 0; i < sizeof units / sizeof units[ 0 ]; i++, scale /= 1000 )
+	{
+		if( strcmp( unit, units[ i ] ) == 0 )
+		{
+			seconds = count * scale;
+			return count > 0;
+		}
+	}
+	return false;
+}
+
+// Value changes of one 1-bit variable. The first value seen is the initial
+// level; every change after that is an edge.
+static bool ReplayVcd( const MappedFile& file, const ReplayOptions& options, ReplayFeed& feed, std::string& error )
+{
+	VcdTokens tokens( file.mData, file.mData + file.mSize );
+	const char* token;
+	size_t length;
+
+	double timescale = 1e-9;
+	std::string id;
+
+	// Declarations
+	for( ;; )
+	{
+		if( !tokens.Next( token, length ) )
+		{
+			error = "no $enddefinitions";
+			return false;
+		}
+
+		if( VcdTokens::Is( token, length, "$timescale" ) )
+		{
+			if( !ReadTimescale( tokens, timescale ) )
+			{
+				error = "can't read $timescale";
+				return false;
+			}
+		}
+		else if( VcdTokens::Is( token, length, "$var" ) )
+		{
+			// $var type size id reference [index] $end
+			const char* fields[ 4 ];
+			size_t lengths[ 4 ];
+			size_t count = 0;
+			while( tokens.Next( token, length ) && !VcdTokens::Is( token, length, "$end" ) )
+			{
+				if( count < 4 )
+				{
+					fields[ count ] = token;
+					lengths[ count ] = length;
+				}
+				count++;
+			}
+
+			if( id.empty() && count >= 4 && VcdTokens::Is( fields[ 1 ], lengths[ 1 ], "1" ) &&
+				( options.mSignal == NULL || VcdTokens::Is( fields[ 3 ], lengths[ 3 ], options.mSignal ) ) )
+				id.assign( fields[ 2 ], lengths[ 2 ] );
+		}
+		else if( VcdTokens::Is( token, length, "$enddefinitions" ) )
+		{
+			tokens.SkipSection();
+			break;
+		}
+		else if( token[ 0 ] == '$' )
+		{
+			tokens.SkipSection();
+		}
+	}
+
+	if( id.empty() )
+	{
+		error = options.mSignal == NULL ? "no 1-bit variable" : std::string( "no 1-bit variable called " ) + options.mSignal;
+		return false;
+	}
+
+	// Value changes
+	double samples_per_tick = timescale * options.mRate;
+	uint64_t sample = 0;
+	int level = -1; // not known yet
+
+	while( tokens.Next( token, length ) )
+	{
+		char c = token[ 0 ];
+		if( c == '#' )
+		{
+			uint64_t ticks = 0;
+			for( size_t i = 1; i < length; i++ )
+				ticks = ticks * 10 + ( token[ i ] - '0' );
+			sample = (uint64_t)( ticks * samples_per_tick + 0.5 );
+		}
+		else if( c == '0' || c == '1' )
+		{
+			if( length - 1 != id.size() || memcmp( token + 1, id.data(), length - 1 ) != 0 )
+				continue;
+
+			int value = c - '0';
+			if( level >= 0 && value != level )
+				feed.Edge( sample, value != 0 );
+			level = value;
+		}
+		else if( c == 'b' || c == 'B' || c == 'r' || c == 'R' )
+		{
+			// A vector or real value; the id follows
+			tokens.Next( token, length );
+		}
+		else if( VcdTokens::Is( token, length, "$comment" ) )
+		{
+			tokens.SkipSection();
+		}
+		// x/z values and $dumpvars-style keywords don't move the level
+	}
+	return true;
+}
+
+static void Usage()
+{
+	fprintf( stderr,
+		"usage: AcuriteReplay [-r rate] [-t threads] [-w repeat_ms] [-c edges] [-g us] [-s signal] [-e] [-q] file...\n"
+		"  -r  sample rate to decode at, in Hz (default %d)\n"
+		"  -t  decode threads (default 1)\n"
+		"  -w  fold repeated copies of a packet within this many ms (default 0: show all)\n"
+		"  -c  fit the pulse-width thresholds to this many edges first (default 0: fixed thresholds)\n"
+		"  -g  drop pulses shorter than this many uS before decoding (default 0: keep all)\n"
+		"  -s  VCD variable to decode (default: the first 1-bit one)\n"
+		"  -e  correct packets that are one bit off\n"
+		"  -q  count packets without printing them\n"
+		"Files are Logic 2 binary digital exports or VCD.\n", REPLAY_DEFAULT_RATE );
+	exit( 2 );
+}
+
+int main( int argc, char** argv )
+{
+	ReplayOptions options;
+
+	int arg = 1;
+	for( ; arg < argc && argv[ arg ][ 0 ] == '-'; arg++ )
+	{
+		const char* flag = argv[ arg ];
+		if( strcmp( flag, "-q" ) == 0 )
+		{
+			options.mQuiet = true;
+			continue;
+		}
+		if( strcmp( flag, "-e" ) == 0 )
+		{
+			options.mCorrectBits = true;
+			continue;
+		}
+		if( flag[ 1 ] == 0 || flag[ 2 ] != 0 || arg + 1 >= argc )
+			Usage();
+
+		const char* value = argv[ ++arg ];
+		switch( flag[ 1 ] )
+		{
+		case 'r': options.mRate = strtoul( value, NULL, 10 ); break;
+		case 't': options.mThreads = strtoul( value, NULL, 10 ); break;
+		case 'w': options.mRepeatWindowMs = strtoul( value, NULL, 10 ); break;
+		case 'c': options.mCalibrationEdges = strtoul( value, NULL, 10 ); break;
+		case 'g': options.mGlitchWidthUs = strtoul( value, NULL, 10 ); break;
+		case 's': options.mSignal = value; break;
+		default: Usage();
+		}
+	}
+
+	if( arg == argc || options.mRate == 0 || options.mThreads == 0 ||
+		options.mRepeatWindowMs > ACURITE_MAX_REPEAT_WINDOW_US / 1000 || options.mGlitchWidthUs > ACURITE_GLITCH_MAX_US )
+		Usage();
+
+	static char output[ 1 << 16 ];
+	setvbuf( stdout, output, _IOFBF, sizeof output );
+
+	AcuriteDecoderOptions decoder_options( options.mRate );
+	decoder_options.mRepeatWindowUs = options.mRepeatWindowMs * 1000;
+	decoder_options.mCalibrationEdges = options.mCalibrationEdges;
+	decoder_options.mCorrectBits = options.mCorrectBits;
+	decoder_options.mGlitchWidthUs = options.mGlitchWidthUs;
+
+	int status = 0;
+	for( ; arg < argc; arg++ )
+	{
+		const char* path = argv[ arg ];
+		MappedFile file;
+		if( !file.Open( path ) )
+		{
+			fprintf( stderr, "AcuriteReplay: %s: can't map file\n", path );
+			status = 1;
+			continue;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		ReplaySink sink( options.mRate, options.mQuiet );
+		AcuriteChannelDecoder decoder( decoder_options, options.mThreads );
+		ReplayFeed feed( decoder, sink );
+
+		std::string error;
+		bool saleae = file.mSize >= 8 && memcmp( file.mData, SALEAE_MAGIC, 8 ) == 0;
+		bool ok = saleae ? ReplaySaleae( file, options, feed, error ) : ReplayVcd( file, options, feed, error );
+		feed.Finish();
+		fflush( stdout );
+
+		double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+		if( seconds <= 0 )
+			seconds = 1e-9;
+
+		if( !ok )
+		{
+			fprintf( stderr, "AcuriteReplay: %s: %s\n", path, error.c_str() );
+			status = 1;
+			continue;
+		}
+
+		fprintf( stderr, "%s: %llu edges, %llu packets (%llu bad, %llu corrected) in %.3f s: %.3g edges/s, %.3g packets/s, %.3g MB/s\n",
+			path, (unsigned long long)feed.mEdges, (unsigned long long)sink.mPackets, (unsigned long long)sink.mBadPackets,
+			(unsigned long long)sink.mCorrectedPackets,
+			seconds, feed.mEdges / seconds, sink.mPackets / seconds, file.mSize / seconds / 1e6 );
+
+		if( options.mGlitchWidthUs > 0 )
+		{
+			const AcuriteGlitchFilter& filter = decoder.GetGlitchFilter();
+			fprintf( stderr, "%s: glitch filter dropped %llu of %llu edges\n",
+				path, (unsigned long long)filter.GetFiltered(), (unsigned long long)filter.GetEdges() );
+		}
+
+		if( options.mCalibrationEdges > 0 )
+		{
+			const AcuRiteTiming& timing = decoder.GetTiming();
+			double us = options.mRate / 1e6;
+			fprintf( stderr, "%s: %s: zero >= %.1f uS, one >= %.1f uS, sync %.1f..%.1f uS, bit <= %.1f uS\n",
+				path, decoder.IsCalibrated() ? "calibrated" : "kept the fixed thresholds",
+				timing.zeroWidth / us, timing.oneWidth / us, timing.syncWidth / us, timing.maxSyncWidth / us, timing.bitWidth / us );
+		}
+	}
+
+	return status;
+}